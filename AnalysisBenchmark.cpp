@@ -0,0 +1,269 @@
+//========================================================================
+// FILE:
+//    AnalysisBenchmark.cpp
+//
+// DESCRIPTION:
+//    Benchmarks the dominator, post-dominator, dominance frontier,
+//    liveness, register pressure and interference graph analyses on
+//    synthetic functions with controllable CFG shapes:
+//      * chain     - straight-line chain of blocks
+//      * loopnest  - perfectly nested loops
+//      * irreducible - a sequence of two-entry (irreducible) loops
+//      * switch    - one wide switch merging into a PHI
+//      * values    - a loop with thousands of values live across it
+//    For every analysis mode it reports the iterations to convergence,
+//    the best wall time over a number of repetitions, the heap allocations
+//    of the first (cold) and of the last (warm) repetition, and the peak
+//    RSS. The interference graph rows also report the edges built per
+//    second of the best time.
+//
+// USAGE:
+//      <BUILD/DIR>/analysis-bench [-size=N] [-repeat=N] [-shape=<name>]
+//
+// License: MIT
+//========================================================================
+#include "CFGShapes.h"
+#include "DominanceFrontiersAnalysis.h"
+#include "DominatorsAnalysis.h"
+#include "InterferenceGraphAnalysis.h"
+#include "LivenessAnalysis.h"
+#include "PostDominatorsAnalysis.h"
+#include "RegisterPressureAnalysis.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <new>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory BenchCategory{"benchmark options"};
+
+static cl::opt<unsigned> Size{
+    "size", cl::desc("Scale of the generated functions (blocks or values)."),
+    cl::init(2000), cl::cat{BenchCategory}};
+
+static cl::opt<unsigned> Repeat{
+    "repeat", cl::desc("Number of timed runs per analysis; the best is kept."),
+    cl::init(3), cl::cat{BenchCategory}};
+
+static cl::opt<std::string> Shape{
+    "shape", cl::desc("Only run the given shape (chain, loopnest, "
+                      "irreducible, switch or values)."),
+    cl::init(""), cl::cat{BenchCategory}};
+
+//===----------------------------------------------------------------------===//
+// Allocation counting
+//===----------------------------------------------------------------------===//
+// Every operator new of the process goes through here. Bit set storage is
+// taken from BitSetWordPool with malloc and counted by the pool itself.
+static std::atomic<uint64_t> NumNewCalls(0);
+
+void *operator new(size_t Size) {
+  NumNewCalls.fetch_add(1, std::memory_order_relaxed);
+  if (void *P = std::malloc(Size ? Size : 1))
+    return P;
+  throw std::bad_alloc();
+}
+void operator delete(void *P) noexcept { std::free(P); }
+void operator delete(void *P, size_t) noexcept { std::free(P); }
+
+static uint64_t getAllocationCount() {
+  return NumNewCalls.load(std::memory_order_relaxed) +
+         BitSetWordPool::get().getCounters().HeapAllocations;
+}
+
+//===----------------------------------------------------------------------===//
+// Measurement
+//===----------------------------------------------------------------------===//
+static long getPeakRSSKB() {
+  struct rusage Usage;
+  getrusage(RUSAGE_SELF, &Usage);
+  return Usage.ru_maxrss;
+}
+
+// Number of edges of a result that builds a graph, reported as a rate.
+template <typename ResultT> static uint64_t getNumEdges(const ResultT &) {
+  return 0;
+}
+static uint64_t getNumEdges(const ResultInterferenceGraph &Graph) {
+  return Graph.NumEdges;
+}
+
+// Runs Fn Repeat times and reports the best time along with the stats of
+// the last run. Results are destroyed between runs, so the warm count
+// shows what is left once their storage can be recycled.
+template <typename ResultT>
+static void measure(StringRef ShapeName, StringRef Mode, Function &F,
+                    std::function<ResultT()> Fn) {
+  double Best = 0;
+  uint64_t ColdAllocs = 0, WarmAllocs = 0, Edges = 0;
+  DataflowStats Stats;
+  for (unsigned I = 0; I < std::max(1U, unsigned(Repeat)); I++) {
+    uint64_t Allocs = getAllocationCount();
+    auto Start = std::chrono::steady_clock::now();
+    decltype(Start) End;
+    {
+      ResultT Result = Fn();
+      End = std::chrono::steady_clock::now();
+      Stats = Result.Stats;
+      Edges = getNumEdges(Result);
+    }
+    Allocs = getAllocationCount() - Allocs;
+    double Ms = std::chrono::duration<double, std::milli>(End - Start).count();
+    if (I == 0 || Ms < Best)
+      Best = Ms;
+    if (I == 0)
+      ColdAllocs = Allocs;
+    WarmAllocs = Allocs;
+  }
+
+  outs() << format("%-12s %-16s %8u %8u %8u %10u %12.3f %12lu %12lu %10ld",
+                   ShapeName.str().c_str(), Mode.str().c_str(), F.size(),
+                   F.getInstructionCount(), Stats.Sweeps, Stats.BlockVisits,
+                   Best, (unsigned long)ColdAllocs, (unsigned long)WarmAllocs,
+                   getPeakRSSKB());
+  if (Edges != 0)
+    outs() << format(" %12.4g", Edges / (std::max(Best, 1e-6) / 1000));
+  else
+    outs() << right_justify("-", 13);
+  outs() << "\n";
+}
+
+struct FusedResult {
+  ResultDominators Dom;
+  ResultLivenessAnalysis Live;
+  DataflowStats Stats;
+};
+
+static void runBenchmarks(StringRef ShapeName, Function &F) {
+  if (verifyFunction(F, &errs()))
+    report_fatal_error("generated function does not verify");
+
+  measure<ResultDominators>(ShapeName, "dom-sets", F, [&] {
+    return DominatorsAnalysis(DomAlgorithm::Sets).runOnFunction(F);
+  });
+  measure<ResultDominators>(ShapeName, "dom-idom", F, [&] {
+    return DominatorsAnalysis(DomAlgorithm::IDom).runOnFunction(F);
+  });
+  measure<ResultPostDominators>(ShapeName, "postdom-sets", F, [&] {
+    return PostDominatorsAnalysis(DomAlgorithm::Sets).runOnFunction(F);
+  });
+  measure<ResultPostDominators>(ShapeName, "postdom-idom", F, [&] {
+    return PostDominatorsAnalysis(DomAlgorithm::IDom).runOnFunction(F);
+  });
+  // Only the walk over a tree computed up front.
+  {
+    FunctionInfo Info(F);
+    ResultDominators Dom =
+        DominatorsAnalysis(DomAlgorithm::IDom).runOnFunction(F, Info);
+    measure<ResultDominanceFrontiers>(ShapeName, "dom-frontiers", F, [&] {
+      return DominanceFrontiersAnalysis().runOnFunction(Dom, Info);
+    });
+  }
+
+  LivenessOptions Options;
+  Options.Algorithm = LivenessAlgorithm::Iterative;
+  measure<ResultLivenessAnalysis>(ShapeName, "live-iterative", F, [&] {
+    return LivenessAnalysis(Options).runOnFunction(F);
+  });
+  Options.Algorithm = LivenessAlgorithm::LoopForest;
+  measure<ResultLivenessAnalysis>(ShapeName, "live-loops", F, [&] {
+    return LivenessAnalysis(Options).runOnFunction(F);
+  });
+  Options.Algorithm = LivenessAlgorithm::PathExploration;
+  measure<ResultLivenessAnalysis>(ShapeName, "live-ssa", F, [&] {
+    return LivenessAnalysis(Options).runOnFunction(F);
+  });
+  // Only the count over live-out sets computed up front.
+  {
+    ResultLivenessAnalysis Live = LivenessAnalysis(Options).runOnFunction(F);
+    PressureOptions Pressure;
+    measure<ResultRegisterPressure>(ShapeName, "pressure", F, [&] {
+      return RegisterPressureAnalysis(Pressure).runOnFunction(F, Live);
+    });
+    Pressure.SplitByClass = true;
+    measure<ResultRegisterPressure>(ShapeName, "pressure-class", F, [&] {
+      return RegisterPressureAnalysis(Pressure).runOnFunction(F, Live);
+    });
+    // The matrix is only used up to InterferenceOptions::MatrixLimit
+    // values; larger functions fall back to the lists.
+    InterferenceOptions Interference;
+    Interference.Storage = InterferenceStorage::Matrix;
+    measure<ResultInterferenceGraph>(ShapeName, "interf-matrix", F, [&] {
+      return InterferenceGraphAnalysis(Interference).runOnFunction(F, Live);
+    });
+    Interference.Storage = InterferenceStorage::Lists;
+    measure<ResultInterferenceGraph>(ShapeName, "interf-lists", F, [&] {
+      return InterferenceGraphAnalysis(Interference).runOnFunction(F, Live);
+    });
+  }
+
+  // Both analyses on one FunctionInfo, as the tool runs them when both are
+  // selected. Compare with the sum of dom-idom and live-ssa.
+  measure<FusedResult>(ShapeName, "dom+live-fused", F, [&] {
+    FunctionInfo Info(F);
+    FusedResult Result;
+    Result.Dom = DominatorsAnalysis(DomAlgorithm::IDom).runOnFunction(F, Info);
+    Result.Live = LivenessAnalysis(Options).runOnFunction(F, Info);
+    Result.Stats = Result.Dom.Stats;
+    Result.Stats += Result.Live.Stats;
+    return Result;
+  });
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  cl::HideUnrelatedOptions(BenchCategory);
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Benchmarks the dominators and liveness "
+                              "analyses on synthetic CFGs\n");
+  llvm_shutdown_obj SDO;
+
+  LLVMContext Ctx;
+  Module M("bench", Ctx);
+  unsigned N = Size;
+
+  struct ShapeInfo {
+    const char *Name;
+    std::function<Function *()> Build;
+  };
+  ShapeInfo Shapes[] = {
+      {"chain", [&] { return buildChain(M, N); }},
+      // Every level adds three blocks; keep the nest depth in check.
+      {"loopnest", [&] { return buildLoopNest(M, std::max(1U, N / 20)); }},
+      {"irreducible", [&] { return buildIrreducible(M, std::max(1U, N / 3)); }},
+      {"switch", [&] { return buildSwitch(M, N); }},
+      {"values", [&] { return buildManyValues(M, N); }},
+  };
+
+  outs() << left_justify("shape", 13) << left_justify("analysis", 17)
+         << right_justify("blocks", 8) << right_justify("insts", 9)
+         << right_justify("sweeps", 9) << right_justify("visits", 11)
+         << right_justify("best-ms", 13) << right_justify("allocs-cold", 13)
+         << right_justify("allocs-warm", 13) << right_justify("peak-kb", 11)
+         << right_justify("edges-per-s", 13) << "\n";
+  for (ShapeInfo &S : Shapes) {
+    if (!Shape.empty() && Shape != S.Name)
+      continue;
+    Function *F = S.Build();
+    runBenchmarks(S.Name, *F);
+    F->eraseFromParent();
+  }
+  return 0;
+}
@@ -0,0 +1,209 @@
+//========================================================================
+// FILE:
+//    AnalysisCache.h
+//
+// DESCRIPTION:
+//    Persistent on-disk cache of analysis results. Every entry is a file
+//    in the cache directory named after a hash of the function it was
+//    computed for, so unchanged functions are not analyzed again by later
+//    runs. The hash covers the CFG and the instruction stream with
+//    operands identified by their position in the function, but not value
+//    names or constants, which the results do not depend on.
+//
+//    Entries are written to a temporary file and renamed into place, so
+//    concurrent runs and threads sharing a directory never see partial
+//    entries. They are read through MemoryBuffer, which maps larger files
+//    instead of copying them. The analyses own the layout of their
+//    payload; an entry that does not decode is treated as a miss.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_ANALYSIS_ANALYSISCACHE_H
+#define LLVM_ANALYSIS_ANALYSISCACHE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <string>
+
+namespace llvm {
+
+// Reads the little-endian words of a cache entry. Reads past the end fail
+// and leave the value untouched.
+class CacheEntryReader {
+public:
+  explicit CacheEntryReader(StringRef Data) : Data(Data) {}
+
+  bool read(uint32_t &V) {
+    if (Data.size() < sizeof(V))
+      return false;
+    V = support::endian::read32le(Data.data());
+    Data = Data.drop_front(sizeof(V));
+    return true;
+  }
+  bool read(uint64_t &V) {
+    if (Data.size() < sizeof(V))
+      return false;
+    V = support::endian::read64le(Data.data());
+    Data = Data.drop_front(sizeof(V));
+    return true;
+  }
+  bool atEnd() const { return Data.empty(); }
+
+private:
+  StringRef Data;
+};
+
+class AnalysisCache {
+public:
+  // Bump when the hash or the layout of any payload changes.
+  enum : uint32_t { Magic = 0x4341544c /* "LTAC" */, Version = 1 };
+
+  explicit AnalysisCache(StringRef Dir) : Dir(Dir.str()) {}
+
+  // Creates the cache directory if needed.
+  std::error_code create() { return sys::fs::create_directories(Dir); }
+
+  // Key of the result of Analysis on F. Arguments, blocks and
+  // instructions are identified by their position in layout order.
+  static std::string getKey(const Function &F, StringRef Analysis) {
+    DenseMap<const Value *, uint64_t> Position;
+    uint64_t Next = 0;
+    for (const Argument &Arg : F.args())
+      Position[&Arg] = Next++;
+    for (const BasicBlock &BB : F) {
+      Position[&BB] = Next++;
+      for (const Instruction &I : BB)
+        Position[&I] = Next++;
+    }
+
+    MD5 Hash;
+    auto AddWord = [&](uint64_t W) {
+      uint8_t Bytes[sizeof(W)];
+      support::endian::write64le(Bytes, W);
+      Hash.update(makeArrayRef(Bytes));
+    };
+    Hash.update(Analysis);
+    AddWord(Version);
+    AddWord(F.arg_size());
+    AddWord(F.size());
+    for (const BasicBlock &BB : F) {
+      AddWord(BB.size());
+      for (const Instruction &I : BB) {
+        AddWord(I.getOpcode());
+        AddWord(I.getType()->isVoidTy());
+        AddWord(I.getNumOperands());
+        for (const Use &U : I.operands())
+          AddWord(getPosition(Position, U.get()));
+        if (const auto *PHI = dyn_cast<PHINode>(&I))
+          for (const BasicBlock *Incoming : PHI->blocks())
+            AddWord(getPosition(Position, Incoming));
+      }
+    }
+
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    return std::string(Result.digest().str());
+  }
+
+  // Looks Key up and passes the payload of the entry to Read, which
+  // returns false if it cannot decode it. Returns true on a hit.
+  bool lookup(StringRef Key, function_ref<bool(StringRef)> Read) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(
+        getPath(Key), /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    bool Hit = false;
+    if (Buffer) {
+      StringRef Data = (*Buffer)->getBuffer();
+      CacheEntryReader Header(Data);
+      uint32_t EntryMagic, EntryVersion;
+      Hit = Header.read(EntryMagic) && EntryMagic == Magic &&
+            Header.read(EntryVersion) && EntryVersion == Version &&
+            Read(Data.drop_front(2 * sizeof(uint32_t)));
+    }
+    ++(Hit ? Hits : Misses);
+    return Hit;
+  }
+
+  // Stores the payload produced by Write under Key. Failures are not
+  // fatal; the result is simply not cached.
+  void store(StringRef Key, function_ref<void(raw_ostream &)> Write) {
+    Expected<sys::fs::TempFile> Temp =
+        sys::fs::TempFile::create(getPath("tmp-%%%%%%%%"));
+    if (!Temp) {
+      consumeError(Temp.takeError());
+      ++StoreFailures;
+      return;
+    }
+    bool WriteFailed;
+    {
+      raw_fd_ostream OS(Temp->FD, /*shouldClose=*/false);
+      support::endian::Writer W(OS, support::little);
+      W.write<uint32_t>(Magic);
+      W.write<uint32_t>(Version);
+      Write(OS);
+      OS.flush();
+      WriteFailed = OS.has_error();
+      OS.clear_error();
+    }
+    if (WriteFailed) {
+      consumeError(Temp->discard());
+      ++StoreFailures;
+      return;
+    }
+    if (Error E = Temp->keep(getPath(Key))) {
+      consumeError(std::move(E));
+      consumeError(Temp->discard());
+      ++StoreFailures;
+    }
+  }
+
+  unsigned getHits() const { return Hits; }
+  unsigned getMisses() const { return Misses; }
+  unsigned getStoreFailures() const { return StoreFailures; }
+
+  void printReport(raw_ostream &OS) const {
+    unsigned Lookups = Hits + Misses;
+    OS << "analysis cache: " << Hits << " hits, " << Misses << " misses";
+    if (Lookups)
+      OS << format(" (%.1f%% hit rate)", 100.0 * Hits / Lookups);
+    if (StoreFailures)
+      OS << ", " << StoreFailures << " entries not written";
+    OS << "\n";
+  }
+
+private:
+  // Position + 1 of a local value, 0 for constants and globals.
+  static uint64_t getPosition(const DenseMap<const Value *, uint64_t> &Position,
+                              const Value *V) {
+    auto It = Position.find(V);
+    return It == Position.end() ? 0 : It->second + 1;
+  }
+
+  std::string getPath(StringRef Name) const {
+    SmallString<128> Path(Dir);
+    sys::path::append(Path, Name);
+    return std::string(Path.str());
+  }
+
+  std::string Dir;
+  // Updated by all threads analyzing functions.
+  std::atomic<unsigned> Hits{0}, Misses{0}, StoreFailures{0};
+};
+
+} // End namespace llvm
+
+#endif // LLVM_ANALYSIS_ANALYSISCACHE_H
@@ -0,0 +1,346 @@
+//========================================================================
+// FILE:
+//    BitSet.h
+//
+// DESCRIPTION:
+//    Declares DenseBitSet, a fixed-size bit-vector set used as the fact
+//    representation of the dataflow analyses. Elements are dense indices
+//    (see BlockNumbering), so meet operations are plain word-parallel
+//    AND/OR loops and change detection is a word compare.
+//
+//    Meets and comparisons of sets longer than KernelMinWords words go
+//    through the vector kernels of BitSetKernels.
+//
+//    Sets of up to InlineWords words are stored inline. Larger sets take
+//    their words from a per-thread pool of power-of-two sized blocks that
+//    are recycled when sets are destroyed, so analysing a function of a
+//    size seen before does not allocate any set storage.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_ANALYSIS_BITSET_H
+#define LLVM_ANALYSIS_BITSET_H
+
+#include "BitSetKernels.h"
+
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemAlloc.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+namespace llvm {
+
+// Recycles the word storage of DenseBitSet. Blocks hold 2^K words and are
+// kept in one intrusive free list per K; they are only returned to the
+// heap when the owning thread exits.
+class BitSetWordPool {
+public:
+  using WordType = uint64_t;
+
+  struct Counters {
+    // Blocks obtained from the heap and blocks served from a free list.
+    uint64_t HeapAllocations = 0;
+    uint64_t Reuses = 0;
+  };
+
+  // The pool of the calling thread. Blocks may be released on another
+  // thread than the one that allocated them; they then join that pool.
+  static BitSetWordPool &get() {
+    static thread_local BitSetWordPool Pool;
+    return Pool;
+  }
+
+  BitSetWordPool() = default;
+  BitSetWordPool(const BitSetWordPool &) = delete;
+  BitSetWordPool &operator=(const BitSetWordPool &) = delete;
+  ~BitSetWordPool() {
+    for (FreeBlock *&Head : FreeLists)
+      while (Head) {
+        FreeBlock *Next = Head->Next;
+        free(Head);
+        Head = Next;
+      }
+  }
+
+  // Returns a block of at least NumWords words; Capacity receives its
+  // actual size.
+  WordType *allocate(unsigned NumWords, unsigned &Capacity) {
+    unsigned K = Log2_32_Ceil(NumWords);
+    Capacity = 1U << K;
+    if (FreeBlock *Head = FreeLists[K]) {
+      FreeLists[K] = Head->Next;
+      ++Stats.Reuses;
+      return reinterpret_cast<WordType *>(Head);
+    }
+    ++Stats.HeapAllocations;
+    return static_cast<WordType *>(safe_malloc(Capacity * sizeof(WordType)));
+  }
+
+  void deallocate(WordType *Words, unsigned Capacity) {
+    unsigned K = Log2_32(Capacity);
+    FreeBlock *Block = reinterpret_cast<FreeBlock *>(Words);
+    Block->Next = FreeLists[K];
+    FreeLists[K] = Block;
+  }
+
+  const Counters &getCounters() const { return Stats; }
+
+private:
+  struct FreeBlock {
+    FreeBlock *Next;
+  };
+
+  FreeBlock *FreeLists[32] = {};
+  Counters Stats;
+};
+
+class DenseBitSet {
+public:
+  using WordType = uint64_t;
+  static constexpr unsigned BitsPerWord = 64;
+  static constexpr unsigned InlineWords = 2;
+  // Shorter sets are combined by inline loops, for which the call through
+  // the kernel table would cost more than it saves.
+  static constexpr unsigned KernelMinWords = 4;
+
+  // Iterates over the indices of the set bits in increasing order.
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = unsigned;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const unsigned *;
+    using reference = unsigned;
+
+    const_iterator(const DenseBitSet &Set, int Idx) : Set(&Set), Idx(Idx) {}
+
+    unsigned operator*() const { return Idx; }
+    const_iterator &operator++() {
+      Idx = Set->findNext(Idx);
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator Tmp = *this;
+      ++*this;
+      return Tmp;
+    }
+    bool operator==(const const_iterator &RHS) const { return Idx == RHS.Idx; }
+    bool operator!=(const const_iterator &RHS) const { return Idx != RHS.Idx; }
+
+  private:
+    const DenseBitSet *Set;
+    int Idx;
+  };
+
+  DenseBitSet() = default;
+  explicit DenseBitSet(unsigned NumBits, bool Value = false) {
+    grow(numWords(NumBits));
+    this->NumBits = NumBits;
+    std::memset(Words, Value ? 0xff : 0, numWords(NumBits) * sizeof(WordType));
+    if (Value)
+      clearUnusedBits();
+  }
+  DenseBitSet(const DenseBitSet &RHS) { *this = RHS; }
+  DenseBitSet(DenseBitSet &&RHS) { *this = std::move(RHS); }
+  ~DenseBitSet() { releaseStorage(); }
+
+  // Copies reuse the existing storage when it is large enough.
+  DenseBitSet &operator=(const DenseBitSet &RHS) {
+    if (this == &RHS)
+      return *this;
+    grow(RHS.getNumWords());
+    NumBits = RHS.NumBits;
+    std::memcpy(Words, RHS.Words, getNumWords() * sizeof(WordType));
+    return *this;
+  }
+  DenseBitSet &operator=(DenseBitSet &&RHS) {
+    if (this == &RHS)
+      return *this;
+    if (!RHS.isInline()) {
+      releaseStorage();
+      Words = RHS.Words;
+      Capacity = RHS.Capacity;
+      NumBits = RHS.NumBits;
+      RHS.Words = RHS.Inline;
+      RHS.Capacity = InlineWords;
+      RHS.NumBits = 0;
+      return *this;
+    }
+    return *this = static_cast<const DenseBitSet &>(RHS);
+  }
+
+  unsigned size() const { return NumBits; }
+  unsigned getNumWords() const { return numWords(NumBits); }
+
+  // Grows or shrinks the set to N bits. Added bits are clear.
+  void resize(unsigned N) {
+    unsigned OldWords = getNumWords(), NewWords = numWords(N);
+    grow(NewWords);
+    if (NewWords > OldWords)
+      std::memset(Words + OldWords, 0, (NewWords - OldWords) * sizeof(WordType));
+    NumBits = N;
+    clearUnusedBits();
+  }
+
+  // Raw word access, for serialization. Bits past size() are dropped.
+  WordType getWord(unsigned I) const {
+    assert(I < getNumWords() && "word index out of range");
+    return Words[I];
+  }
+  void setWord(unsigned I, WordType W) {
+    assert(I < getNumWords() && "word index out of range");
+    Words[I] = W;
+    clearUnusedBits();
+  }
+
+  bool test(unsigned Idx) const {
+    assert(Idx < NumBits && "bit index out of range");
+    return Words[Idx / BitsPerWord] & (WordType(1) << (Idx % BitsPerWord));
+  }
+  void set(unsigned Idx) {
+    assert(Idx < NumBits && "bit index out of range");
+    Words[Idx / BitsPerWord] |= WordType(1) << (Idx % BitsPerWord);
+  }
+  void reset(unsigned Idx) {
+    assert(Idx < NumBits && "bit index out of range");
+    Words[Idx / BitsPerWord] &= ~(WordType(1) << (Idx % BitsPerWord));
+  }
+
+  void setAll() {
+    std::memset(Words, 0xff, getNumWords() * sizeof(WordType));
+    clearUnusedBits();
+  }
+  void resetAll() {
+    std::memset(Words, 0, getNumWords() * sizeof(WordType));
+  }
+
+  // this &= RHS
+  void intersectWith(const DenseBitSet &RHS) {
+    assert(NumBits == RHS.NumBits && "set size mismatch");
+    unsigned E = getNumWords();
+    if (E > KernelMinWords)
+      return BitSetKernels::get().Intersect(Words, RHS.Words, E);
+    for (unsigned I = 0; I != E; ++I)
+      Words[I] &= RHS.Words[I];
+  }
+  // this |= RHS
+  void unionWith(const DenseBitSet &RHS) {
+    assert(NumBits == RHS.NumBits && "set size mismatch");
+    unsigned E = getNumWords();
+    if (E > KernelMinWords)
+      return BitSetKernels::get().Union(Words, RHS.Words, E);
+    for (unsigned I = 0; I != E; ++I)
+      Words[I] |= RHS.Words[I];
+  }
+  // this &= ~RHS
+  void subtract(const DenseBitSet &RHS) {
+    assert(NumBits == RHS.NumBits && "set size mismatch");
+    unsigned E = getNumWords();
+    if (E > KernelMinWords)
+      return BitSetKernels::get().Subtract(Words, RHS.Words, E);
+    for (unsigned I = 0; I != E; ++I)
+      Words[I] &= ~RHS.Words[I];
+  }
+
+  // this |= Gen | (In & ~Kill), the backward transfer of a block folded
+  // into the meet of its predecessor.
+  void unionWithGenKill(const DenseBitSet &Gen, const DenseBitSet &In,
+                        const DenseBitSet &Kill) {
+    assert(NumBits == Gen.NumBits && NumBits == In.NumBits &&
+           NumBits == Kill.NumBits && "set size mismatch");
+    unsigned E = getNumWords();
+    if (E > KernelMinWords)
+      return BitSetKernels::get().UnionGenKill(Words, Gen.Words, In.Words,
+                                               Kill.Words, E);
+    for (unsigned I = 0; I != E; ++I)
+      Words[I] |= Gen.Words[I] | (In.Words[I] & ~Kill.Words[I]);
+  }
+
+  bool operator==(const DenseBitSet &RHS) const {
+    if (NumBits != RHS.NumBits)
+      return false;
+    unsigned E = getNumWords();
+    if (E > KernelMinWords)
+      return BitSetKernels::get().Equal(Words, RHS.Words, E);
+    for (unsigned I = 0; I != E; ++I)
+      if (Words[I] != RHS.Words[I])
+        return false;
+    return true;
+  }
+  bool operator!=(const DenseBitSet &RHS) const { return !(*this == RHS); }
+
+  bool any() const {
+    for (unsigned I = 0, E = getNumWords(); I != E; ++I)
+      if (Words[I])
+        return true;
+    return false;
+  }
+  unsigned count() const {
+    unsigned N = 0;
+    for (unsigned I = 0, E = getNumWords(); I != E; ++I)
+      N += countPopulation(Words[I]);
+    return N;
+  }
+
+  // Returns the first set bit after Prev, or -1 if there is none.
+  int findNext(int Prev) const {
+    unsigned Idx = Prev + 1;
+    if (Idx >= NumBits)
+      return -1;
+    unsigned WordIdx = Idx / BitsPerWord;
+    WordType W = Words[WordIdx] & (~WordType(0) << (Idx % BitsPerWord));
+    while (true) {
+      if (W)
+        return WordIdx * BitsPerWord + countTrailingZeros(W);
+      if (++WordIdx == getNumWords())
+        return -1;
+      W = Words[WordIdx];
+    }
+  }
+  int findFirst() const { return findNext(-1); }
+
+  const_iterator begin() const { return const_iterator(*this, findFirst()); }
+  const_iterator end() const { return const_iterator(*this, -1); }
+
+private:
+  static unsigned numWords(unsigned NumBits) {
+    return (NumBits + BitsPerWord - 1) / BitsPerWord;
+  }
+  void clearUnusedBits() {
+    if (unsigned Extra = NumBits % BitsPerWord)
+      Words[NumBits / BitsPerWord] &= ~(~WordType(0) << Extra);
+  }
+
+  bool isInline() const { return Words == Inline; }
+
+  // Makes room for NumWords words, keeping the current ones.
+  void grow(unsigned NumWords) {
+    if (NumWords <= Capacity)
+      return;
+    unsigned NewCapacity;
+    WordType *NewWords =
+        BitSetWordPool::get().allocate(NumWords, NewCapacity);
+    std::memcpy(NewWords, Words, getNumWords() * sizeof(WordType));
+    releaseStorage();
+    Words = NewWords;
+    Capacity = NewCapacity;
+  }
+  void releaseStorage() {
+    if (!isInline())
+      BitSetWordPool::get().deallocate(Words, Capacity);
+    Words = Inline;
+    Capacity = InlineWords;
+  }
+
+  WordType *Words = Inline;
+  unsigned Capacity = InlineWords;
+  unsigned NumBits = 0;
+  WordType Inline[InlineWords];
+};
+
+} // End namespace llvm
+
+#endif // LLVM_ANALYSIS_BITSET_H
@@ -0,0 +1,340 @@
+//=============================================================================
+// FILE:
+//    BitSetKernels.cpp
+//
+// DESCRIPTION:
+//    Scalar, SSE2, AVX2 and AVX-512 versions of the DenseBitSet kernels and
+//    their selection from the features of the host CPU. The vector versions
+//    are compiled with per-function target attributes, so the rest of the
+//    tool keeps the baseline ISA and runs on any CPU.
+//
+// License: MIT
+//=============================================================================
+#include "BitSetKernels.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Host.h"
+
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define BITSET_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace llvm;
+
+using WordType = BitSetKernels::WordType;
+
+static cl::opt<BitSetISA> ForcedKernels(
+    "bitset-kernels", cl::Hidden,
+    cl::desc("Use the given bit set kernels instead of the best ones the CPU "
+             "supports"),
+    cl::values(clEnumValN(BitSetISA::Scalar, "scalar", "Portable C++"),
+               clEnumValN(BitSetISA::SSE2, "sse2", "SSE2"),
+               clEnumValN(BitSetISA::AVX2, "avx2", "AVX2"),
+               clEnumValN(BitSetISA::AVX512, "avx512", "AVX-512")));
+
+//-----------------------------------------------------------------------------
+// Scalar kernels, also used for the words left over by the vector loops
+//-----------------------------------------------------------------------------
+static void unionScalar(WordType *Dst, const WordType *Src, unsigned N){
+    for(unsigned I = 0; I != N; I++)
+      Dst[I] |= Src[I];
+}
+
+static void intersectScalar(WordType *Dst, const WordType *Src, unsigned N){
+    for(unsigned I = 0; I != N; I++)
+      Dst[I] &= Src[I];
+}
+
+static void subtractScalar(WordType *Dst, const WordType *Src, unsigned N){
+    for(unsigned I = 0; I != N; I++)
+      Dst[I] &= ~Src[I];
+}
+
+static void unionGenKillScalar(WordType *Dst, const WordType *Gen,
+                               const WordType *In, const WordType *Kill,
+                               unsigned N){
+    for(unsigned I = 0; I != N; I++)
+      Dst[I] |= Gen[I] | (In[I] & ~Kill[I]);
+}
+
+static bool equalScalar(const WordType *A, const WordType *B, unsigned N){
+    for(unsigned I = 0; I != N; I++)
+      if(A[I] != B[I])
+        return false;
+    return true;
+}
+
+#ifdef BITSET_KERNELS_X86
+//-----------------------------------------------------------------------------
+// SSE2 kernels, two words per vector
+//-----------------------------------------------------------------------------
+__attribute__((target("sse2")))
+static void unionSSE2(WordType *Dst, const WordType *Src, unsigned N){
+    unsigned I = 0;
+    for(; I + 2 <= N; I += 2){
+      __m128i D = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Dst + I));
+      __m128i S = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Src + I));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(Dst + I), _mm_or_si128(D, S));
+    }
+    unionScalar(Dst + I, Src + I, N - I);
+}
+
+__attribute__((target("sse2")))
+static void intersectSSE2(WordType *Dst, const WordType *Src, unsigned N){
+    unsigned I = 0;
+    for(; I + 2 <= N; I += 2){
+      __m128i D = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Dst + I));
+      __m128i S = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Src + I));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(Dst + I), _mm_and_si128(D, S));
+    }
+    intersectScalar(Dst + I, Src + I, N - I);
+}
+
+__attribute__((target("sse2")))
+static void subtractSSE2(WordType *Dst, const WordType *Src, unsigned N){
+    unsigned I = 0;
+    for(; I + 2 <= N; I += 2){
+      __m128i D = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Dst + I));
+      __m128i S = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Src + I));
+      // andnot(a, b) is ~a & b.
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(Dst + I), _mm_andnot_si128(S, D));
+    }
+    subtractScalar(Dst + I, Src + I, N - I);
+}
+
+__attribute__((target("sse2")))
+static void unionGenKillSSE2(WordType *Dst, const WordType *Gen,
+                             const WordType *In, const WordType *Kill,
+                             unsigned N){
+    unsigned I = 0;
+    for(; I + 2 <= N; I += 2){
+      __m128i D = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Dst + I));
+      __m128i G = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Gen + I));
+      __m128i L = _mm_loadu_si128(reinterpret_cast<const __m128i *>(In + I));
+      __m128i K = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Kill + I));
+      D = _mm_or_si128(D, _mm_or_si128(G, _mm_andnot_si128(K, L)));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(Dst + I), D);
+    }
+    unionGenKillScalar(Dst + I, Gen + I, In + I, Kill + I, N - I);
+}
+
+__attribute__((target("sse2")))
+static bool equalSSE2(const WordType *A, const WordType *B, unsigned N){
+    unsigned I = 0;
+    for(; I + 2 <= N; I += 2){
+      __m128i X = _mm_loadu_si128(reinterpret_cast<const __m128i *>(A + I));
+      __m128i Y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(B + I));
+      if(_mm_movemask_epi8(_mm_cmpeq_epi8(X, Y)) != 0xffff)
+        return false;
+    }
+    return equalScalar(A + I, B + I, N - I);
+}
+
+//-----------------------------------------------------------------------------
+// AVX2 kernels, four words per vector
+//-----------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void unionAVX2(WordType *Dst, const WordType *Src, unsigned N){
+    unsigned I = 0;
+    for(; I + 4 <= N; I += 4){
+      __m256i D = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Dst + I));
+      __m256i S = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Src + I));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(Dst + I), _mm256_or_si256(D, S));
+    }
+    unionScalar(Dst + I, Src + I, N - I);
+}
+
+__attribute__((target("avx2")))
+static void intersectAVX2(WordType *Dst, const WordType *Src, unsigned N){
+    unsigned I = 0;
+    for(; I + 4 <= N; I += 4){
+      __m256i D = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Dst + I));
+      __m256i S = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Src + I));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(Dst + I), _mm256_and_si256(D, S));
+    }
+    intersectScalar(Dst + I, Src + I, N - I);
+}
+
+__attribute__((target("avx2")))
+static void subtractAVX2(WordType *Dst, const WordType *Src, unsigned N){
+    unsigned I = 0;
+    for(; I + 4 <= N; I += 4){
+      __m256i D = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Dst + I));
+      __m256i S = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Src + I));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(Dst + I), _mm256_andnot_si256(S, D));
+    }
+    subtractScalar(Dst + I, Src + I, N - I);
+}
+
+__attribute__((target("avx2")))
+static void unionGenKillAVX2(WordType *Dst, const WordType *Gen,
+                             const WordType *In, const WordType *Kill,
+                             unsigned N){
+    unsigned I = 0;
+    for(; I + 4 <= N; I += 4){
+      __m256i D = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Dst + I));
+      __m256i G = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Gen + I));
+      __m256i L = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(In + I));
+      __m256i K = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Kill + I));
+      D = _mm256_or_si256(D, _mm256_or_si256(G, _mm256_andnot_si256(K, L)));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(Dst + I), D);
+    }
+    unionGenKillScalar(Dst + I, Gen + I, In + I, Kill + I, N - I);
+}
+
+__attribute__((target("avx2")))
+static bool equalAVX2(const WordType *A, const WordType *B, unsigned N){
+    unsigned I = 0;
+    for(; I + 4 <= N; I += 4){
+      __m256i X = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(A + I));
+      __m256i Y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(B + I));
+      __m256i Diff = _mm256_xor_si256(X, Y);
+      if(!_mm256_testz_si256(Diff, Diff))
+        return false;
+    }
+    return equalScalar(A + I, B + I, N - I);
+}
+
+//-----------------------------------------------------------------------------
+// AVX-512 kernels, eight words per vector. The last partial vector goes to
+// the AVX2 kernels: masked stores cannot be forwarded to the loads of the
+// next update of the same set, which made short sets slower than scalar.
+//-----------------------------------------------------------------------------
+__attribute__((target("avx512f")))
+static void unionAVX512(WordType *Dst, const WordType *Src, unsigned N){
+    unsigned I = 0;
+    for(; I + 8 <= N; I += 8){
+      __m512i D = _mm512_loadu_si512(Dst + I);
+      __m512i S = _mm512_loadu_si512(Src + I);
+      _mm512_storeu_si512(Dst + I, _mm512_or_si512(D, S));
+    }
+    unionAVX2(Dst + I, Src + I, N - I);
+}
+
+__attribute__((target("avx512f")))
+static void intersectAVX512(WordType *Dst, const WordType *Src, unsigned N){
+    unsigned I = 0;
+    for(; I + 8 <= N; I += 8){
+      __m512i D = _mm512_loadu_si512(Dst + I);
+      __m512i S = _mm512_loadu_si512(Src + I);
+      _mm512_storeu_si512(Dst + I, _mm512_and_si512(D, S));
+    }
+    intersectAVX2(Dst + I, Src + I, N - I);
+}
+
+__attribute__((target("avx512f")))
+static void subtractAVX512(WordType *Dst, const WordType *Src, unsigned N){
+    unsigned I = 0;
+    for(; I + 8 <= N; I += 8){
+      __m512i D = _mm512_loadu_si512(Dst + I);
+      __m512i S = _mm512_loadu_si512(Src + I);
+      _mm512_storeu_si512(Dst + I, _mm512_andnot_si512(S, D));
+    }
+    subtractAVX2(Dst + I, Src + I, N - I);
+}
+
+__attribute__((target("avx512f")))
+static void unionGenKillAVX512(WordType *Dst, const WordType *Gen,
+                               const WordType *In, const WordType *Kill,
+                               unsigned N){
+    unsigned I = 0;
+    for(; I + 8 <= N; I += 8){
+      __m512i D = _mm512_loadu_si512(Dst + I);
+      __m512i G = _mm512_loadu_si512(Gen + I);
+      __m512i L = _mm512_loadu_si512(In + I);
+      __m512i K = _mm512_loadu_si512(Kill + I);
+      // Truth table of G | (L & ~K), with G, L and K as the first, second
+      // and third operand.
+      __m512i T = _mm512_ternarylogic_epi64(G, L, K, 0xf4);
+      _mm512_storeu_si512(Dst + I, _mm512_or_si512(D, T));
+    }
+    unionGenKillAVX2(Dst + I, Gen + I, In + I, Kill + I, N - I);
+}
+
+__attribute__((target("avx512f")))
+static bool equalAVX512(const WordType *A, const WordType *B, unsigned N){
+    unsigned I = 0;
+    for(; I + 8 <= N; I += 8){
+      __m512i X = _mm512_loadu_si512(A + I);
+      __m512i Y = _mm512_loadu_si512(B + I);
+      if(_mm512_cmpneq_epi64_mask(X, Y))
+        return false;
+    }
+    return equalAVX2(A + I, B + I, N - I);
+}
+#endif // BITSET_KERNELS_X86
+
+//-----------------------------------------------------------------------------
+// Selection
+//-----------------------------------------------------------------------------
+static const BitSetKernels AllKernels[] = {
+    {BitSetISA::Scalar, "scalar", unionScalar, intersectScalar,
+     subtractScalar, unionGenKillScalar, equalScalar},
+#ifdef BITSET_KERNELS_X86
+    {BitSetISA::SSE2, "sse2", unionSSE2, intersectSSE2, subtractSSE2,
+     unionGenKillSSE2, equalSSE2},
+    {BitSetISA::AVX2, "avx2", unionAVX2, intersectAVX2, subtractAVX2,
+     unionGenKillAVX2, equalAVX2},
+    {BitSetISA::AVX512, "avx512", unionAVX512, intersectAVX512,
+     subtractAVX512, unionGenKillAVX512, equalAVX512},
+#endif
+};
+
+static bool hostSupports(BitSetISA ISA){
+    // getHostCPUFeatures also checks that the OS saves the vector state.
+    static const StringMap<bool> Features = []{
+      StringMap<bool> Features;
+      if(!sys::getHostCPUFeatures(Features))
+        Features.clear();
+      return Features;
+    }();
+    auto Has = [&](StringRef Name){ return Features.lookup(Name); };
+    switch(ISA){
+    case BitSetISA::Scalar:
+      return true;
+    case BitSetISA::SSE2:
+      return Has("sse2");
+    case BitSetISA::AVX2:
+      return Has("avx2");
+    case BitSetISA::AVX512:
+      // The AVX-512 kernels finish with the AVX2 ones.
+      return Has("avx512f") && Has("avx2");
+    }
+    llvm_unreachable("unknown bit set ISA");
+}
+
+ArrayRef<const BitSetKernels *> BitSetKernels::available(){
+    static const std::vector<const BitSetKernels *> Usable = []{
+      std::vector<const BitSetKernels *> Usable;
+      for(const BitSetKernels &K : AllKernels)
+        if(hostSupports(K.ISA))
+          Usable.push_back(&K);
+      return Usable;
+    }();
+    return Usable;
+}
+
+const BitSetKernels *BitSetKernels::lookup(BitSetISA ISA){
+    for(const BitSetKernels *K : available())
+      if(K->ISA == ISA)
+        return K;
+    return nullptr;
+}
+
+const BitSetKernels &BitSetKernels::get(){
+    static const BitSetKernels &Selected = []() -> const BitSetKernels & {
+      if(!ForcedKernels.getNumOccurrences())
+        return *available().back();
+      if(const BitSetKernels *K = lookup(ForcedKernels))
+        return *K;
+      report_fatal_error("the kernels forced with -bitset-kernels are not "
+                         "supported by this build or CPU");
+    }();
+    return Selected;
+}
@@ -0,0 +1,51 @@
+//========================================================================
+// FILE:
+//    BitSetKernels.h
+//
+// DESCRIPTION:
+//    Word-array kernels behind the set operations of DenseBitSet: union,
+//    intersection, difference, the gen/kill update of the liveness meet
+//    and equality. Besides the scalar versions there are SSE2, AVX2 and
+//    AVX-512 versions on x86. The best version the host CPU supports is
+//    chosen the first time the kernels are used; the hidden option
+//    -bitset-kernels=<scalar|sse2|avx2|avx512> forces one.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_ANALYSIS_BITSETKERNELS_H
+#define LLVM_ANALYSIS_BITSETKERNELS_H
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <cstdint>
+
+namespace llvm {
+
+enum class BitSetISA { Scalar, SSE2, AVX2, AVX512 };
+
+struct BitSetKernels {
+  using WordType = uint64_t;
+
+  BitSetISA ISA;
+  const char *Name;
+  // Dst |= Src, Dst &= Src and Dst &= ~Src over N words.
+  void (*Union)(WordType *Dst, const WordType *Src, unsigned N);
+  void (*Intersect)(WordType *Dst, const WordType *Src, unsigned N);
+  void (*Subtract)(WordType *Dst, const WordType *Src, unsigned N);
+  // Dst |= Gen | (In & ~Kill) over N words.
+  void (*UnionGenKill)(WordType *Dst, const WordType *Gen, const WordType *In,
+                       const WordType *Kill, unsigned N);
+  bool (*Equal)(const WordType *A, const WordType *B, unsigned N);
+
+  // The kernels selected for this process.
+  static const BitSetKernels &get();
+  // The kernels for ISA, or nullptr if they were not built or the host CPU
+  // does not support them.
+  static const BitSetKernels *lookup(BitSetISA ISA);
+  // All kernels usable on the host CPU, scalar first.
+  static ArrayRef<const BitSetKernels *> available();
+};
+
+} // End namespace llvm
+
+#endif // LLVM_ANALYSIS_BITSETKERNELS_H
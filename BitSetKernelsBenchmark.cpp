@@ -0,0 +1,155 @@
+//========================================================================
+// FILE:
+//    BitSetKernelsBenchmark.cpp
+//
+// DESCRIPTION:
+//    Micro-benchmark of the DenseBitSet kernels. Every kernel is timed in
+//    every version the host CPU supports on sets from 64 to 100k bits.
+//    For each it reports the time per call, the memory throughput over the
+//    words read and written, and the speedup over the scalar version.
+//
+// USAGE:
+//      <BUILD/DIR>/bitset-kernels-bench [-bits=N,N,...] [-repeat=N]
+//
+// License: MIT
+//========================================================================
+#include "BitSetKernels.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory BenchCategory{"benchmark options"};
+
+static cl::list<unsigned> Widths{
+    "bits", cl::desc("Set sizes to measure, in bits."), cl::CommaSeparated,
+    cl::cat{BenchCategory}};
+
+static cl::opt<unsigned> Repeat{
+    "repeat", cl::desc("Number of timed runs per measurement; the best is "
+                       "kept."),
+    cl::init(5), cl::cat{BenchCategory}};
+
+//===----------------------------------------------------------------------===//
+// Measurement
+//===----------------------------------------------------------------------===//
+using WordType = BitSetKernels::WordType;
+
+// Operand arrays of one measurement. Equal compares A with a copy of
+// itself, so it always scans the whole set.
+struct Operands {
+  std::vector<WordType> Dst, A, B, C, CopyOfA;
+
+  explicit Operands(unsigned NumWords)
+      : Dst(NumWords), A(NumWords), B(NumWords), C(NumWords) {
+    std::mt19937_64 Rng(NumWords);
+    for (unsigned I = 0; I != NumWords; I++) {
+      Dst[I] = Rng();
+      A[I] = Rng();
+      B[I] = Rng();
+      C[I] = Rng();
+    }
+    CopyOfA = A;
+  }
+};
+
+struct KernelInfo {
+  const char *Name;
+  // Words read and written per set word, for the throughput.
+  unsigned WordsTouched;
+  std::function<void(const BitSetKernels &, Operands &, unsigned)> Run;
+};
+
+// Best time per call in nanoseconds. Each run repeats the kernel on about
+// 2^24 words so short sets are not dominated by the clock.
+static double timeKernel(const KernelInfo &Kernel, const BitSetKernels &K,
+                         Operands &Ops, unsigned NumWords) {
+  unsigned Calls = std::max(1U, (1U << 24) / NumWords);
+  double Best = 0;
+  for (unsigned R = 0; R < std::max(1U, unsigned(Repeat)); R++) {
+    auto Start = std::chrono::steady_clock::now();
+    for (unsigned I = 0; I != Calls; I++)
+      Kernel.Run(K, Ops, NumWords);
+    auto End = std::chrono::steady_clock::now();
+    double Ns = std::chrono::duration<double, std::nano>(End - Start).count() /
+                Calls;
+    if (R == 0 || Ns < Best)
+      Best = Ns;
+  }
+  return Best;
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  cl::HideUnrelatedOptions(BenchCategory);
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Measures the throughput of the bit set "
+                              "kernels\n");
+  llvm_shutdown_obj SDO;
+
+  SmallVector<unsigned, 8> Bits(Widths.begin(), Widths.end());
+  if (Bits.empty())
+    Bits.append({64, 256, 1024, 4096, 16384, 65536, 100000});
+
+  // Sink for the results of Equal, so the calls are not dropped.
+  volatile bool Sink = false;
+  KernelInfo Kernels[] = {
+      {"union", 3,
+       [](const BitSetKernels &K, Operands &Ops, unsigned N) {
+         K.Union(Ops.Dst.data(), Ops.A.data(), N);
+       }},
+      {"intersect", 3,
+       [](const BitSetKernels &K, Operands &Ops, unsigned N) {
+         K.Intersect(Ops.Dst.data(), Ops.A.data(), N);
+       }},
+      {"subtract", 3,
+       [](const BitSetKernels &K, Operands &Ops, unsigned N) {
+         K.Subtract(Ops.Dst.data(), Ops.A.data(), N);
+       }},
+      {"union-gen-kill", 5,
+       [](const BitSetKernels &K, Operands &Ops, unsigned N) {
+         K.UnionGenKill(Ops.Dst.data(), Ops.A.data(), Ops.B.data(),
+                        Ops.C.data(), N);
+       }},
+      {"equal", 2,
+       [&](const BitSetKernels &K, Operands &Ops, unsigned N) {
+         Sink = K.Equal(Ops.A.data(), Ops.CopyOfA.data(), N);
+       }},
+  };
+
+  outs() << left_justify("kernel", 16) << left_justify("isa", 8)
+         << right_justify("bits", 8) << right_justify("ns/call", 12)
+         << right_justify("GB/s", 10) << right_justify("speedup", 10) << "\n";
+  for (const KernelInfo &Kernel : Kernels) {
+    for (unsigned NumBits : Bits) {
+      unsigned NumWords = std::max(1U, (NumBits + 63) / 64);
+      Operands Ops(NumWords);
+      double ScalarNs = 0;
+      for (const BitSetKernels *K : BitSetKernels::available()) {
+        double Ns = timeKernel(Kernel, *K, Ops, NumWords);
+        if (K->ISA == BitSetISA::Scalar)
+          ScalarNs = Ns;
+        double Bytes =
+            double(Kernel.WordsTouched) * NumWords * sizeof(WordType);
+        outs() << format("%-16s %-8s %7u %11.2f %9.2f %9.2fx\n", Kernel.Name,
+                         K->Name, NumBits, Ns, Bytes / Ns, ScalarNs / Ns);
+      }
+    }
+  }
+  (void)Sink;
+  return 0;
+}
@@ -0,0 +1,56 @@
+//========================================================================
+// FILE:
+//    BlockNumbering.h
+//
+// DESCRIPTION:
+//    Maps the basic blocks of a function to dense indices [0, N) in layout
+//    order, so per-block facts can be stored in vectors and sets of blocks
+//    can be stored as bit vectors.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_ANALYSIS_BLOCKNUMBERING_H
+#define LLVM_ANALYSIS_BLOCKNUMBERING_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Function.h"
+
+#include <vector>
+
+namespace llvm {
+
+class BlockNumbering {
+public:
+  enum : unsigned { InvalidIndex = ~0U };
+
+  BlockNumbering() = default;
+  explicit BlockNumbering(const Function &F) {
+    Blocks.reserve(F.size());
+    Index.reserve(F.size());
+    for (const BasicBlock &BB : F) {
+      Index[&BB] = Blocks.size();
+      Blocks.push_back(&BB);
+    }
+  }
+
+  unsigned size() const { return Blocks.size(); }
+
+  const BasicBlock *getBlock(unsigned Idx) const { return Blocks[Idx]; }
+
+  // Returns InvalidIndex for blocks that do not belong to the function.
+  unsigned getIndex(const BasicBlock *BB) const {
+    auto It = Index.find(BB);
+    return It == Index.end() ? InvalidIndex : It->second;
+  }
+
+  ArrayRef<const BasicBlock *> blocks() const { return Blocks; }
+
+private:
+  std::vector<const BasicBlock *> Blocks;
+  DenseMap<const BasicBlock *, unsigned> Index;
+};
+
+} // End namespace llvm
+
+#endif // LLVM_ANALYSIS_BLOCKNUMBERING_H
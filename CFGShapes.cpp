@@ -0,0 +1,183 @@
+//========================================================================
+// FILE:
+//    CFGShapes.cpp
+//
+// DESCRIPTION:
+//    Generators of synthetic functions with controllable CFG shapes, used
+//    by analysis-bench and by the tests.
+//
+// License: MIT
+//========================================================================
+#include "CFGShapes.h"
+
+#include "llvm/IR/IRBuilder.h"
+
+#include <functional>
+
+using namespace llvm;
+
+// All generated functions have the signature i32 (i32 %a, i32 %b).
+static Function *createFunction(Module &M, StringRef Name) {
+  LLVMContext &Ctx = M.getContext();
+  Type *I32 = Type::getInt32Ty(Ctx);
+  FunctionType *FTy = FunctionType::get(I32, {I32, I32}, false);
+  Function *F = Function::Create(FTy, GlobalValue::ExternalLinkage, Name, M);
+  F->getArg(0)->setName("a");
+  F->getArg(1)->setName("b");
+  return F;
+}
+
+// entry -> b1 -> b2 -> ... -> bN, each block extending a chain of values.
+Function *llvm::buildChain(Module &M, unsigned N) {
+  Function *F = createFunction(M, "chain");
+  LLVMContext &Ctx = M.getContext();
+  IRBuilder<> B(BasicBlock::Create(Ctx, "entry", F));
+  Value *V = B.CreateAdd(F->getArg(0), F->getArg(1));
+  for (unsigned I = 0; I != N; I++) {
+    BasicBlock *Next = BasicBlock::Create(Ctx, "b", F);
+    B.CreateBr(Next);
+    B.SetInsertPoint(Next);
+    V = B.CreateAdd(V, F->getArg(1));
+  }
+  B.CreateRet(V);
+  return F;
+}
+
+// Depth nested counted loops, each carrying an accumulator in a PHI.
+Function *llvm::buildLoopNest(Module &M, unsigned Depth) {
+  Function *F = createFunction(M, "loopnest");
+  LLVMContext &Ctx = M.getContext();
+  Type *I32 = Type::getInt32Ty(Ctx);
+  IRBuilder<> B(BasicBlock::Create(Ctx, "entry", F));
+  Value *Acc = B.CreateAdd(F->getArg(0), F->getArg(1));
+
+  std::function<Value *(unsigned, Value *)> EmitLoop =
+      [&](unsigned Level, Value *In) -> Value * {
+    if (Level == Depth)
+      return B.CreateXor(In, F->getArg(1));
+    BasicBlock *Pre = B.GetInsertBlock();
+    BasicBlock *Header = BasicBlock::Create(Ctx, "header", F);
+    BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", F);
+    B.CreateBr(Header);
+
+    B.SetInsertPoint(Header);
+    PHINode *IV = B.CreatePHI(I32, 2, "iv");
+    PHINode *Sum = B.CreatePHI(I32, 2, "sum");
+    IV->addIncoming(ConstantInt::get(I32, 0), Pre);
+    Sum->addIncoming(In, Pre);
+    Value *Body = EmitLoop(Level + 1, Sum);
+    Value *Next = B.CreateAdd(IV, ConstantInt::get(I32, 1));
+    Value *Cond = B.CreateICmpSLT(Next, F->getArg(0));
+    BasicBlock *Latch = B.GetInsertBlock();
+    B.CreateCondBr(Cond, Header, Exit);
+    IV->addIncoming(Next, Latch);
+    Sum->addIncoming(Body, Latch);
+
+    B.SetInsertPoint(Exit);
+    return B.CreateAdd(Body, IV);
+  };
+
+  B.CreateRet(EmitLoop(0, Acc));
+  return F;
+}
+
+// N regions, each a loop with two entries X -> {L, R}, L <-> R, {L, R} -> next.
+Function *llvm::buildIrreducible(Module &M, unsigned N) {
+  Function *F = createFunction(M, "irreducible");
+  LLVMContext &Ctx = M.getContext();
+  Type *I32 = Type::getInt32Ty(Ctx);
+  IRBuilder<> B(BasicBlock::Create(Ctx, "entry", F));
+  Value *V = B.CreateAdd(F->getArg(0), F->getArg(1));
+
+  for (unsigned I = 0; I != N; I++) {
+    BasicBlock *X = B.GetInsertBlock();
+    BasicBlock *L = BasicBlock::Create(Ctx, "left", F);
+    BasicBlock *R = BasicBlock::Create(Ctx, "right", F);
+    BasicBlock *Next = BasicBlock::Create(Ctx, "next", F);
+    B.CreateCondBr(B.CreateICmpSLT(V, F->getArg(1)), L, R);
+
+    B.SetInsertPoint(L);
+    PHINode *PL = B.CreatePHI(I32, 2, "l");
+    Value *VL = B.CreateSub(PL, F->getArg(1));
+    B.CreateCondBr(B.CreateICmpEQ(VL, F->getArg(0)), Next, R);
+
+    B.SetInsertPoint(R);
+    PHINode *PR = B.CreatePHI(I32, 2, "r");
+    Value *VR = B.CreateAdd(PR, F->getArg(1));
+    B.CreateCondBr(B.CreateICmpEQ(VR, F->getArg(0)), Next, L);
+
+    PL->addIncoming(V, X);
+    PL->addIncoming(VR, R);
+    PR->addIncoming(V, X);
+    PR->addIncoming(VL, L);
+
+    B.SetInsertPoint(Next);
+    PHINode *PN = B.CreatePHI(I32, 2, "m");
+    PN->addIncoming(VL, L);
+    PN->addIncoming(VR, R);
+    V = PN;
+  }
+  B.CreateRet(V);
+  return F;
+}
+
+// switch %a with N cases, each computing a value merged by one PHI.
+Function *llvm::buildSwitch(Module &M, unsigned N) {
+  Function *F = createFunction(M, "switch");
+  LLVMContext &Ctx = M.getContext();
+  Type *I32 = Type::getInt32Ty(Ctx);
+  BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", F);
+  BasicBlock *Merge = BasicBlock::Create(Ctx, "merge", F);
+  IRBuilder<> B(Entry);
+  Value *Base = B.CreateMul(F->getArg(1), F->getArg(1));
+  SwitchInst *SI = B.CreateSwitch(F->getArg(0), Merge, N);
+
+  B.SetInsertPoint(Merge);
+  PHINode *Phi = B.CreatePHI(I32, N + 1, "merged");
+  Phi->addIncoming(Base, Entry);
+  for (unsigned I = 0; I != N; I++) {
+    BasicBlock *Case = BasicBlock::Create(Ctx, "case", F);
+    SI->addCase(ConstantInt::get(cast<IntegerType>(I32), I), Case);
+    B.SetInsertPoint(Case);
+    Value *V = B.CreateAdd(Base, ConstantInt::get(I32, I));
+    B.CreateBr(Merge);
+    Phi->addIncoming(V, Case);
+  }
+  B.SetInsertPoint(Merge);
+  B.CreateRet(B.CreateAdd(Phi, Base));
+  return F;
+}
+
+// N values defined up front, all live across a loop, then summed.
+Function *llvm::buildManyValues(Module &M, unsigned N) {
+  Function *F = createFunction(M, "values");
+  LLVMContext &Ctx = M.getContext();
+  Type *I32 = Type::getInt32Ty(Ctx);
+  BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", F);
+  BasicBlock *Loop = BasicBlock::Create(Ctx, "loop", F);
+  BasicBlock *Body = BasicBlock::Create(Ctx, "body", F);
+  BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", F);
+
+  IRBuilder<> B(Entry);
+  std::vector<Value *> Values;
+  for (unsigned I = 0; I != N; I++)
+    Values.push_back(B.CreateAdd(F->getArg(0), ConstantInt::get(I32, I)));
+  B.CreateBr(Loop);
+
+  B.SetInsertPoint(Loop);
+  PHINode *IV = B.CreatePHI(I32, 2, "iv");
+  IV->addIncoming(ConstantInt::get(I32, 0), Entry);
+  B.CreateCondBr(B.CreateICmpSLT(IV, F->getArg(1)), Body, Exit);
+
+  B.SetInsertPoint(Body);
+  Value *Next = B.CreateAdd(IV, ConstantInt::get(I32, 1));
+  IV->addIncoming(Next, Body);
+  B.CreateBr(Loop);
+
+  B.SetInsertPoint(Exit);
+  Value *Sum = IV;
+  for (Value *V : Values)
+    Sum = B.CreateAdd(Sum, V);
+  B.CreateRet(Sum);
+  return F;
+}
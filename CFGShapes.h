@@ -0,0 +1,38 @@
+//========================================================================
+// FILE:
+//    CFGShapes.h
+//
+// DESCRIPTION:
+//    Generators of synthetic functions with controllable CFG shapes:
+//      * chain       - straight-line chain of blocks
+//      * loopnest    - perfectly nested loops
+//      * irreducible - a sequence of two-entry (irreducible) loops
+//      * switch      - one wide switch merging into a PHI
+//      * values      - a loop with many values live across it
+//    Every function is added to M, has the signature i32 (i32 %a, i32 %b)
+//    and is named after its shape.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_ANALYSIS_CFGSHAPES_H
+#define LLVM_ANALYSIS_CFGSHAPES_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+namespace llvm {
+
+// entry -> b1 -> ... -> bN.
+Function *buildChain(Module &M, unsigned N);
+// Depth nested counted loops, three blocks per level.
+Function *buildLoopNest(Module &M, unsigned Depth);
+// N two-entry loops in sequence, four blocks each.
+Function *buildIrreducible(Module &M, unsigned N);
+// One switch with N cases.
+Function *buildSwitch(Module &M, unsigned N);
+// N values live across a loop.
+Function *buildManyValues(Module &M, unsigned N);
+
+} // End namespace llvm
+
+#endif // LLVM_ANALYSIS_CFGSHAPES_H
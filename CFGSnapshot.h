@@ -0,0 +1,148 @@
+//========================================================================
+// FILE:
+//    CFGSnapshot.h
+//
+// DESCRIPTION:
+//    A read-only copy of the CFG of a function over dense block indices
+//    (see BlockNumbering). The successor and predecessor lists of all
+//    blocks are stored back to back in compressed sparse row form, so
+//    walking the edges of a block reads one contiguous range instead of
+//    chasing terminator operands and use lists. The snapshot does not
+//    follow later edits of the CFG.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_ANALYSIS_CFGSNAPSHOT_H
+#define LLVM_ANALYSIS_CFGSNAPSHOT_H
+
+#include "BlockNumbering.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/CFG.h"
+
+#include <cassert>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+
+// Adjacency lists of N nodes in compressed sparse row form: the
+// neighbours of node I are Targets[Begin[I]] .. Targets[Begin[I + 1] - 1].
+class CSRAdjacency {
+public:
+  CSRAdjacency() : Begin(1, 0) {}
+
+  // Builds the lists of N nodes from (From, To) pairs. The neighbours of
+  // each node keep the order in which their edges appear in Edges.
+  CSRAdjacency(unsigned N, ArrayRef<std::pair<unsigned, unsigned>> Edges)
+      : Begin(N + 1, 0), Targets(Edges.size()) {
+    for (const auto &E : Edges) {
+      assert(E.first < N && E.second < N && "edge endpoint out of range");
+      ++Begin[E.first + 1];
+    }
+    for (unsigned I = 0; I != N; ++I)
+      Begin[I + 1] += Begin[I];
+    // Begin[I] serves as the fill position of node I, which leaves it at
+    // the start of node I + 1; shift the offsets back afterwards.
+    for (const auto &E : Edges)
+      Targets[Begin[E.first]++] = E.second;
+    for (unsigned I = N; I != 0; --I)
+      Begin[I] = Begin[I - 1];
+    Begin[0] = 0;
+  }
+
+  // Takes over lists already laid out in this form.
+  CSRAdjacency(std::vector<unsigned> Begin, std::vector<unsigned> Targets)
+      : Begin(std::move(Begin)), Targets(std::move(Targets)) {
+    assert(!this->Begin.empty() && this->Begin.back() == this->Targets.size() &&
+           "offsets do not cover the targets");
+  }
+
+  unsigned size() const { return Begin.size() - 1; }
+  unsigned getNumEdges() const { return Targets.size(); }
+
+  ArrayRef<unsigned> operator[](unsigned I) const {
+    assert(I < size() && "node index out of range");
+    return makeArrayRef(Targets.data() + Begin[I], Targets.data() + Begin[I + 1]);
+  }
+
+private:
+  std::vector<unsigned> Begin;
+  std::vector<unsigned> Targets;
+};
+
+class CFGSnapshot {
+public:
+  CFGSnapshot() = default;
+  explicit CFGSnapshot(const BlockNumbering &Numbering) {
+    unsigned NumEdges = 0;
+    for (const BasicBlock *BB : Numbering.blocks())
+      if (const Instruction *Term = BB->getTerminator())
+        NumEdges += Term->getNumSuccessors();
+    std::vector<std::pair<unsigned, unsigned>> Edges;
+    Edges.reserve(NumEdges);
+    for (unsigned B = 0, E = Numbering.size(); B != E; ++B)
+      for (const BasicBlock *SuccBB : llvm::successors(Numbering.getBlock(B)))
+        Edges.push_back({B, Numbering.getIndex(SuccBB)});
+    Succs = CSRAdjacency(Numbering.size(), Edges);
+    for (auto &E : Edges)
+      std::swap(E.first, E.second);
+    Preds = CSRAdjacency(Numbering.size(), Edges);
+  }
+
+  // A graph of N nodes given by its (From, To) edges, which need not be
+  // the CFG of a function. Successors keep the order of Edges.
+  CFGSnapshot(unsigned N, std::vector<std::pair<unsigned, unsigned>> Edges)
+      : Succs(N, Edges) {
+    for (auto &E : Edges)
+      std::swap(E.first, E.second);
+    Preds = CSRAdjacency(N, Edges);
+  }
+
+  unsigned size() const { return Succs.size(); }
+  unsigned getNumEdges() const { return Succs.getNumEdges(); }
+
+  // Edges in terminator order. A block branching twice to the same
+  // successor lists it twice, as llvm::successors does. Predecessors are
+  // ordered by block index.
+  ArrayRef<unsigned> successors(unsigned B) const { return Succs[B]; }
+  ArrayRef<unsigned> predecessors(unsigned B) const { return Preds[B]; }
+
+  // The nodes reachable from Entry in reverse post-order, starting with
+  // Entry. Successors are visited in order.
+  std::vector<unsigned> reversePostOrder(unsigned Entry) const {
+    // Iterative DFS: the node and the position of the next successor to
+    // visit.
+    std::vector<unsigned> PostOrder;
+    PostOrder.reserve(size());
+    std::vector<bool> Visited(size(), false);
+    SmallVector<std::pair<unsigned, unsigned>, 32> Stack;
+    Visited[Entry] = true;
+    Stack.push_back({Entry, 0});
+    while (!Stack.empty()) {
+      unsigned B = Stack.back().first;
+      unsigned &Next = Stack.back().second;
+      ArrayRef<unsigned> Succs = successors(B);
+      if (Next == Succs.size()) {
+        PostOrder.push_back(B);
+        Stack.pop_back();
+        continue;
+      }
+      unsigned S = Succs[Next++];
+      if (!Visited[S]) {
+        Visited[S] = true;
+        Stack.push_back({S, 0});
+      }
+    }
+    return std::vector<unsigned>(PostOrder.rbegin(), PostOrder.rend());
+  }
+
+private:
+  CSRAdjacency Succs;
+  CSRAdjacency Preds;
+};
+
+} // End namespace llvm
+
+#endif // LLVM_ANALYSIS_CFGSNAPSHOT_H
@@ -0,0 +1,184 @@
+//========================================================================
+// FILE:
+//    DataflowSolver.h
+//
+// DESCRIPTION:
+//    A worklist-driven fixed-point solver shared by the dataflow analyses.
+//    The solver is parameterized on the direction of the problem and takes
+//    the meet operator and the transfer function as callables. Blocks are
+//    processed in priority order (reverse post-order for forward problems,
+//    post-order for backward problems) and a block is only revisited when
+//    one of the facts it depends on changed. The edges between blocks are
+//    kept in CSR arrays, so the inputs of a block are one contiguous range.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_ANALYSIS_DATAFLOWSOLVER_H
+#define LLVM_ANALYSIS_DATAFLOWSOLVER_H
+
+#include "FunctionInfo.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/Support/Timer.h"
+
+#include <utility>
+#include <vector>
+
+namespace llvm {
+
+enum class DataflowDirection { Forward, Backward };
+
+struct DataflowStats {
+  // Number of passes over the priority order. A pass ends when the solver
+  // wraps around to a block with a lower priority than the previous one.
+  unsigned Sweeps = 0;
+  // Number of blocks whose fact was recomputed.
+  unsigned BlockVisits = 0;
+  // Number of visits that changed the fact of the block.
+  unsigned Changes = 0;
+  // Number of elements added to and removed from the block facts.
+  unsigned SetInsertions = 0;
+  unsigned SetErasures = 0;
+  // Number of fact comparisons made to detect a change.
+  unsigned SetCompares = 0;
+
+  // Time spent building the local facts, running to a fixed point, and
+  // expanding the block facts into the final result (per-instruction live
+  // sets, dominator tree numbering).
+  TimeRecord InitTime;
+  TimeRecord FixedPointTime;
+  TimeRecord ExpansionTime;
+
+  DataflowStats &operator+=(const DataflowStats &RHS) {
+    Sweeps += RHS.Sweeps;
+    BlockVisits += RHS.BlockVisits;
+    Changes += RHS.Changes;
+    SetInsertions += RHS.SetInsertions;
+    SetErasures += RHS.SetErasures;
+    SetCompares += RHS.SetCompares;
+    InitTime += RHS.InitTime;
+    FixedPointTime += RHS.FixedPointTime;
+    ExpansionTime += RHS.ExpansionTime;
+    return *this;
+  }
+};
+
+// Adds the time spent in its scope to a TimeRecord.
+class PhaseTimer {
+public:
+  explicit PhaseTimer(TimeRecord &Total)
+      : Total(Total), Start(TimeRecord::getCurrentTime(/*Start=*/true)) {}
+  ~PhaseTimer() {
+    TimeRecord Elapsed = TimeRecord::getCurrentTime(/*Start=*/false);
+    Elapsed -= Start;
+    Total += Elapsed;
+  }
+
+private:
+  TimeRecord &Total;
+  TimeRecord Start;
+};
+
+template <DataflowDirection Direction> class DataflowSolver {
+public:
+  // Order lists the blocks taking part in the problem, highest priority
+  // first: reverse post-order for forward problems and post-order for
+  // backward problems. Edges from or to blocks that are not in Order are
+  // ignored.
+  DataflowSolver(const FunctionInfo &Info, ArrayRef<unsigned> Order)
+      : DataflowSolver(Info.CFG, Order) {}
+
+  // Solves the problem on an arbitrary graph, such as the reversed CFG of
+  // the post-dominators.
+  DataflowSolver(const CFGSnapshot &CFG, ArrayRef<unsigned> Order)
+      : Order(Order.begin(), Order.end()),
+        Rank(CFG.size(), BlockNumbering::InvalidIndex) {
+    for (unsigned I = 0, E = Order.size(); I != E; ++I)
+      Rank[Order[I]] = I;
+
+    // Edges along which facts flow: B -> S for forward problems and S -> B
+    // for backward ones.
+    std::vector<std::pair<unsigned, unsigned>> Flow;
+    Flow.reserve(CFG.getNumEdges());
+    for (unsigned B : Order) {
+      for (unsigned S : CFG.successors(B)) {
+        if (Rank[S] == BlockNumbering::InvalidIndex)
+          continue;
+        if (Direction == DataflowDirection::Forward)
+          Flow.push_back({B, S});
+        else
+          Flow.push_back({S, B});
+      }
+    }
+    unsigned NumBlocks = CFG.size();
+    Dependents = CSRAdjacency(NumBlocks, Flow);
+    for (auto &E : Flow)
+      std::swap(E.first, E.second);
+    Inputs = CSRAdjacency(NumBlocks, Flow);
+  }
+
+  // Blocks whose fact is an input of block B's fact.
+  ArrayRef<unsigned> inputs(unsigned B) const { return Inputs[B]; }
+
+  // Runs the problem to a fixed point, starting with every block in the
+  // worklist. For each visited block B the solver calls:
+  //   Init(Acc, B)       reset the accumulator to the identity of the meet,
+  //   Meet(Acc, From)    fold the contribution of input block From into Acc,
+  //   Transfer(B, Acc)   compute and store the new fact of B from Acc, and
+  //                      return true if it changed.
+  template <typename FactT, typename InitFnT, typename MeetFnT,
+            typename TransferFnT>
+  DataflowStats solve(FactT &Acc, InitFnT Init, MeetFnT Meet,
+                      TransferFnT Transfer) const {
+    BitVector Pending(Order.size(), true);
+    return run(Pending, Acc, Init, Meet, Transfer);
+  }
+
+private:
+  template <typename FactT, typename InitFnT, typename MeetFnT,
+            typename TransferFnT>
+  DataflowStats run(BitVector &Pending, FactT &Acc, InitFnT &Init,
+                    MeetFnT &Meet, TransferFnT &Transfer) const {
+    DataflowStats Stats;
+    if (Order.empty())
+      return Stats;
+
+    int Cursor = Pending.find_first();
+    if (Cursor != -1)
+      Stats.Sweeps = 1;
+    while (Cursor != -1) {
+      Pending.reset(Cursor);
+      unsigned B = Order[Cursor];
+
+      Init(Acc, B);
+      for (unsigned From : Inputs[B])
+        Meet(Acc, From);
+      ++Stats.BlockVisits;
+      if (Transfer(B, Acc)) {
+        ++Stats.Changes;
+        for (unsigned D : Dependents[B])
+          Pending.set(Rank[D]);
+      }
+
+      // Continue in priority order, wrapping around for the next sweep.
+      int Next = Pending.find_next(Cursor);
+      if (Next == -1) {
+        Next = Pending.find_first();
+        if (Next != -1)
+          ++Stats.Sweeps;
+      }
+      Cursor = Next;
+    }
+    return Stats;
+  }
+
+  std::vector<unsigned> Order;
+  std::vector<unsigned> Rank;
+  CSRAdjacency Inputs;
+  CSRAdjacency Dependents;
+};
+
+} // End namespace llvm
+
+#endif // LLVM_ANALYSIS_DATAFLOWSOLVER_H
@@ -0,0 +1,141 @@
+//=============================================================================
+// FILE:
+//    DominanceFrontiersAnalysis.cpp
+//
+// DESCRIPTION:
+//    Computes the dominance frontier of every block from the dominator
+//    tree. Registered by the DominatorsAnalysis plugin.
+//
+// USAGE:
+//    New PM printer
+//      opt -load-pass-plugin=libDominatorsAnalysis.dylib `\`
+//        -passes="print<df>" -disable-output <input-llvm-file>
+//
+// License: MIT
+//=============================================================================
+#include "DominanceFrontiersAnalysis.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/JSON.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "df"
+
+STATISTIC(NumFunctions, "Number of functions analyzed");
+STATISTIC(NumFrontierBlocks, "Number of blocks added to dominance frontiers");
+
+AnalysisKey DominanceFrontiersAnalysis::Key;
+
+// A join point B is in the frontier of every block on the tree path from
+// each of its predecessors up to, but not including, idom(B). Paths from
+// different predecessors merge; once a walk reaches a block that already
+// has B, the rest of its path has B too, so every frontier entry is added
+// exactly once. Blocks are visited in order, which sorts the frontiers.
+static void computeFrontiers(ResultDominanceFrontiers &res,
+                             const ResultDominators &Dom,
+                             const FunctionInfo &Info){
+    const unsigned Invalid = BlockNumbering::InvalidIndex;
+    res.Numbering = Info.Numbering;
+    res.Stats = DataflowStats();
+    PhaseTimer Timer(res.Stats.ExpansionTime);
+    unsigned NumBlocks = Info.Numbering.size();
+    std::vector<std::pair<unsigned, unsigned>> Edges;
+    std::vector<unsigned> LastJoin(NumBlocks, Invalid);
+    for(unsigned B = 0; B != NumBlocks; B++){
+      if(Dom.DFSIn[B] == Invalid)
+        continue;
+      res.Stats.BlockVisits++;
+      for(unsigned P : Info.predecessors(B)){
+        if(Dom.DFSIn[P] == Invalid)
+          continue;
+        for(unsigned Runner = P; Runner != Dom.IDom[B] && LastJoin[Runner] != B;
+            Runner = Dom.IDom[Runner]){
+          LastJoin[Runner] = B;
+          Edges.push_back({Runner, B});
+        }
+      }
+    }
+    res.Stats.Sweeps = 1;
+    res.Stats.SetInsertions = Edges.size();
+    res.Frontier = CSRAdjacency(NumBlocks, Edges);
+}
+
+ResultDominanceFrontiers DominanceFrontiersAnalysis::run(
+    Function &F, FunctionAnalysisManager &MAM){
+    const FunctionInfo &Info = MAM.getResult<FunctionInfoAnalysis>(F);
+    // The walk only needs the tree, which a result of either mode holds.
+    // A Sets-mode result is not worth its O(N^2) sets unless it is already
+    // cached.
+    if(const ResultDominators *Dom = MAM.getCachedResult<DominatorsAnalysis>(F))
+      return runOnFunction(*Dom, Info);
+    return runOnFunction(
+        DominatorsAnalysis(DomAlgorithm::IDom).runOnFunction(F, Info), Info);
+}
+
+ResultDominanceFrontiers DominanceFrontiersAnalysis::runOnFunction(Function &F){
+    FunctionInfo Info(F);
+    ResultDominators Dom =
+        DominatorsAnalysis(DomAlgorithm::IDom).runOnFunction(F, Info);
+    return runOnFunction(Dom, Info);
+}
+
+ResultDominanceFrontiers DominanceFrontiersAnalysis::runOnFunction(
+    const ResultDominators &Dom, const FunctionInfo &Info){
+    ResultDominanceFrontiers res;
+    computeFrontiers(res, Dom, Info);
+    NumFunctions++;
+    NumFrontierBlocks += res.Stats.SetInsertions;
+    return res;
+}
+
+ArrayRef<unsigned>
+ResultDominanceFrontiers::getFrontier(const BasicBlock *BB) const {
+    unsigned Idx = Numbering.getIndex(BB);
+    if(Idx == BlockNumbering::InvalidIndex)
+      return None;
+    return Frontier[Idx];
+}
+
+bool ResultDominanceFrontiers::invalidate(
+    Function &F, const PreservedAnalyses &PA,
+    FunctionAnalysisManager::Invalidator &Inv) {
+  auto PAC = PA.getChecker<DominanceFrontiersAnalysis>();
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>() ||
+           PAC.preservedSet<CFGAnalyses>());
+}
+
+// Dominance frontier printer implementation
+PreservedAnalyses
+DominanceFrontiersAnalysisPrinter::run(Function &F,
+                                      FunctionAnalysisManager &MAM) {
+  const ResultDominanceFrontiers &DF =
+      MAM.getResult<DominanceFrontiersAnalysis>(F);
+  const BlockNumbering &Numbering = DF.Numbering;
+  if (Numbering.size() == 0)
+    return PreservedAnalyses::all();
+
+  ValueNameCache Names(F);
+  for (unsigned B = 0; B != Numbering.size(); B++) {
+    const BasicBlock &BB = *Numbering.getBlock(B);
+    if (Format == OutputFormat::JSONLines) {
+      json::OStream J(OS);
+      J.object([&] {
+        J.attribute("function", F.getName());
+        J.attribute("block", Names.get(BB));
+        J.attributeArray("frontier", [&] {
+          for (unsigned Idx : DF.getFrontier(B))
+            J.value(Names.get(*Numbering.getBlock(Idx)));
+        });
+      });
+      OS << "\n";
+      continue;
+    }
+
+    OS << "(DominanceFrontiersAnalysis) Basic Block " << Names.get(BB) << "{ ";
+    for (unsigned Idx : DF.getFrontier(B))
+      OS << Names.get(*Numbering.getBlock(Idx)) << " ";
+    OS << "}\n";
+  }
+  return PreservedAnalyses::all();
+}
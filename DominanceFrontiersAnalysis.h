@@ -0,0 +1,79 @@
+//========================================================================
+// FILE:
+//    DominanceFrontiersAnalysis.h
+//
+// DESCRIPTION:
+//    Declares the DominanceFrontiersAnalysis pass and its printer. The
+//    frontiers are read off the dominator tree of DominatorsAnalysis in
+//    one pass over the join points of the CFG, walking up the tree from
+//    their predecessors (Cooper, Harvey and Kennedy), so the work is
+//    proportional to the size of the frontiers.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_DOMINANCEFRONTIERSANALYSIS_H
+#define LLVM_DOMINANCEFRONTIERSANALYSIS_H
+
+#include "CFGSnapshot.h"
+#include "DominatorsAnalysis.h"
+
+namespace llvm {
+
+struct ResultDominanceFrontiers {
+  BlockNumbering Numbering;
+  // Frontier[B] lists the blocks of the dominance frontier of block B by
+  // increasing block number. Empty for unreachable blocks, which are also
+  // never part of a frontier.
+  CSRAdjacency Frontier;
+  // Timing of the pass over the tree, as the expansion phase.
+  DataflowStats Stats;
+
+  // Kept when DominanceFrontiersAnalysis or the CFG is preserved.
+  bool invalidate(Function &F, const PreservedAnalyses &PA,
+                  FunctionAnalysisManager::Invalidator &Inv);
+
+  ArrayRef<const BasicBlock *> blocks() const { return Numbering.blocks(); }
+  ArrayRef<unsigned> getFrontier(unsigned B) const { return Frontier[B]; }
+  // Returns an empty list for blocks that are not part of the function.
+  ArrayRef<unsigned> getFrontier(const BasicBlock *BB) const;
+};
+
+class DominanceFrontiersAnalysis
+    : public AnalysisInfoMixin<DominanceFrontiersAnalysis> {
+public:
+  using Result = ResultDominanceFrontiers;
+
+  // Uses the FunctionInfo cached by AM, computing it if needed, and the
+  // tree of a cached DominatorsAnalysis result of either mode. Without
+  // one, the immediate dominators are computed for this run only.
+  Result run(Function &F, FunctionAnalysisManager &AM);
+  // Computes the immediate dominators of F first.
+  Result runOnFunction(Function &F);
+  // Frontiers from the dominator tree Dom of the function described by
+  // Info. Dom may have been computed with either algorithm.
+  Result runOnFunction(const ResultDominators &Dom, const FunctionInfo &Info);
+
+private:
+  static AnalysisKey Key;
+  friend struct AnalysisInfoMixin<DominanceFrontiersAnalysis>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class DominanceFrontiersAnalysisPrinter
+    : public PassInfoMixin<DominanceFrontiersAnalysisPrinter> {
+public:
+  explicit DominanceFrontiersAnalysisPrinter(
+      raw_ostream &OutS, OutputFormat Format = OutputFormat::Text)
+      : OS(OutS), Format(Format) {}
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &MAM);
+
+private:
+  raw_ostream &OS;
+  OutputFormat Format;
+};
+
+} // End namespace llvm
+
+#endif // LLVM_DOMINANCEFRONTIERSANALYSIS_H
@@ -12,24 +12,52 @@
 //    2. New PM
 //      opt -load-pass-plugin=libDominatorsAnalysis.dylib -passes="dominance" `\`
 //        -disable-output <input-llvm-file>
-//
+//    3. New PM printer, optionally selecting the algorithm (sets or idom)
+//      opt -load-pass-plugin=libDominatorsAnalysis.dylib `\`
+//        -passes="print<dom<idom>>" -disable-output <input-llvm-file>
+//    4. The plugin also provides the post-dominators and the dominance
+//       frontiers, see PostDominatorsAnalysis.cpp and
+//       DominanceFrontiersAnalysis.cpp
+//      opt -load-pass-plugin=libDominatorsAnalysis.dylib `\`
+//        -passes="print<postdom>,print<df>" -disable-output <input-llvm-file>
 //
 // License: MIT
 //=============================================================================
 #include "DominatorsAnalysis.h"
-#include "llvm/ADT/MapVector.h"
-#include "llvm/ADT/SmallPtrSet.h"
+#include "AnalysisCache.h"
+#include "DataflowSolver.h"
+#include "DominanceFrontiersAnalysis.h"
+#include "PostDominatorsAnalysis.h"
+#include "ValueNames.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace llvm;
 
+#define DEBUG_TYPE "dom"
+
+STATISTIC(NumFunctions, "Number of functions analyzed");
+STATISTIC(NumSweeps, "Number of sweeps to reach the fixed point");
+STATISTIC(NumBlockVisits, "Number of block visits");
+STATISTIC(NumChanges, "Number of block visits that changed a dominator set");
+STATISTIC(NumSetInsertions, "Number of blocks added to dominator sets");
+STATISTIC(NumSetErasures, "Number of blocks removed from dominator sets");
+STATISTIC(NumSetCompares, "Number of dominator set comparisons");
+STATISTIC(NumIncrementalUpdates, "Number of update batches applied in place");
+STATISTIC(NumFallbackUpdates, "Number of update batches that recomputed everything");
+STATISTIC(NumCachedFunctions, "Number of functions loaded from the result cache");
 
-// Pretty-prints the result of this analysis
-static void printDominatorsResult(llvm::raw_ostream &OutS,
-                         const ResultDominators &Dominators);
+static cl::opt<bool> VerifyDomUpdates(
+    "verify-dom-updates", cl::init(false), cl::Hidden,
+    cl::desc("Compare the dominators against a full recompute after every "
+             "incremental update"));
 
 //-----------------------------------------------------------------------------
 // DominatorsAnalysis implementation
@@ -37,103 +65,762 @@ static void printDominatorsResult(llvm::raw_ostream &OutS,
 
 // This method implements what the pass does
 ResultDominators DominatorsAnalysis::run(Function &F, FunctionAnalysisManager &MAM) {
-  return runOnFunction(F);
+  // The shared per-function facts are only computed on a cache miss.
+  return compute(F, [&]() -> const FunctionInfo & {
+    return MAM.getResult<FunctionInfoAnalysis>(F);
+  });
 }
 
-ResultDominators DominatorsAnalysis::runOnFunction(Function &F){
-    ResultDominators res;
-    Dominators &dom = res.dom;
-
-    for(auto &BB : F){
-      // Insert dom(entry) = entry
-      if(BB.isEntryBlock()){
-        auto set = dom.insert(std::make_pair(&BB, llvm::SmallPtrSet<const llvm::BasicBlock*, 8>())).first;
-        set->second.insert(&BB);
-
-      } else {
-        // dom(i != entry) = N (all BBs)
-        auto set = dom.insert(std::make_pair(&BB, llvm::SmallPtrSet<const llvm::BasicBlock*, 8>())).first;
-        for(auto &EveryBB: F){
-          set->second.insert(&EveryBB);
+// Iterative data-flow over the dominator sets, driven by the worklist
+// solver in reverse post-order. Unreachable blocks are dominated only by
+// themselves and are ignored as predecessors.
+static void computeDominatorSets(ResultDominators &res,
+                                 const DataflowSolver<DataflowDirection::Forward> &Solver,
+                                 ArrayRef<unsigned> RPO){
+    std::vector<DenseBitSet> &dom = res.Dom;
+    unsigned NumBlocks = res.IDom.size();
+    unsigned Entry = RPO.front();
+    DataflowStats &Stats = res.Stats;
+    Optional<PhaseTimer> Timer;
+    Timer.emplace(Stats.InitTime);
+
+    // Insert dom(entry) = entry and dom(i != entry) = N (all BBs)
+    dom.assign(NumBlocks, DenseBitSet(NumBlocks, /*Value=*/true));
+    std::vector<bool> Reachable(NumBlocks, false);
+    for(unsigned I : RPO){
+      Reachable[I] = true;
+    }
+    for(unsigned I = 0; I != NumBlocks; I++){
+      if(I == Entry || !Reachable[I]){
+        dom[I].resetAll();
+        dom[I].set(I);
+      }
+    }
+
+    // dom(i) = {i} U intersection of dom(p) for all predecessors p
+    Timer.emplace(Stats.FixedPointTime);
+    DenseBitSet NewSet(NumBlocks);
+    Stats += Solver.solve(NewSet,
+        [](DenseBitSet &Acc, unsigned) { Acc.setAll(); },
+        [&](DenseBitSet &Acc, unsigned Pred) { Acc.intersectWith(dom[Pred]); },
+        [&](unsigned BB, DenseBitSet &Acc) {
+          if(BB == Entry)
+            return false;
+          // BB must be in this set
+          Acc.set(BB);
+          Stats.SetCompares++;
+          if(Acc == dom[BB])
+            return false;
+          // Dominator sets only shrink.
+          Stats.SetErasures += dom[BB].count() - Acc.count();
+          std::swap(dom[BB], Acc);
+          return true;
+        });
+
+    // The strict dominators of a block form a chain, and its immediate
+    // dominator is the one with the largest dominator set.
+    Timer.emplace(Stats.ExpansionTime);
+    std::vector<unsigned> Depth(NumBlocks);
+    for(unsigned I : RPO){
+      Depth[I] = dom[I].count();
+    }
+    for(unsigned I : RPO.drop_front()){
+      unsigned Best = BlockNumbering::InvalidIndex;
+      for(unsigned D : dom[I]){
+        if(D != I && (Best == BlockNumbering::InvalidIndex || Depth[D] > Depth[Best])){
+          Best = D;
         }
       }
+      res.IDom[I] = Best;
     }
+}
 
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+static void computeIDoms(ResultDominators &res,
+                         const DataflowSolver<DataflowDirection::Forward> &Solver,
+                         ArrayRef<unsigned> RPO){
+    std::vector<unsigned> &IDom = res.IDom;
+    std::vector<unsigned> RPONumber(IDom.size(), BlockNumbering::InvalidIndex);
+    for(unsigned I = 0; I != RPO.size(); I++){
+      RPONumber[RPO[I]] = I;
+    }
+
+    auto Intersect = [&](unsigned A, unsigned B){
+      while(A != B){
+        while(RPONumber[A] > RPONumber[B]) A = IDom[A];
+        while(RPONumber[B] > RPONumber[A]) B = IDom[B];
+      }
+      return A;
+    };
+
+    // The entry temporarily dominates itself so that Intersect terminates.
+    DataflowStats &Stats = res.Stats;
+    PhaseTimer Timer(Stats.FixedPointTime);
+    IDom[RPO.front()] = RPO.front();
     bool changed = true;
     while(changed){
       changed = false;
-      auto IT = F.begin();
-      IT++; // ignore first;
-  
-      // For each BB different from entry
-      for( ; IT != F.end(); IT++){
-        llvm::SmallPtrSet<const llvm::BasicBlock*, 8> NewSet;
-        llvm::MapVector<const llvm::BasicBlock*, unsigned> AuxMap; // track BB counts for intersection purposes
-        auto const &BB = *IT;
-        auto ActualSet = dom[&BB];
-        const_pred_iterator PI = pred_begin(&BB), E = pred_end(&BB);
-        unsigned NPred = pred_size(&BB);
-
-        // For each predecessor of BB
-        for(; PI != E; PI++){
-          // get the dominator set of each BB
-          auto PredSet = dom[*PI];
-
-          //Add each BB in dominator set, on NewSet
-          for(auto TempBB : PredSet){
-            NewSet.insert(TempBB);
-            auto ITMap = AuxMap.find(TempBB);
-            if(AuxMap.end() == ITMap){
-              ITMap = AuxMap.insert(std::make_pair(TempBB, 0)).first;
-            }
-            // Track the occurrence of BB in all sets
-            ITMap->second++;
-          }
+      Stats.Sweeps++;
+      for(unsigned I : RPO.drop_front()){
+        Stats.BlockVisits++;
+        unsigned NewIDom = BlockNumbering::InvalidIndex;
+        for(unsigned P : Solver.inputs(I)){
+          if(IDom[P] == BlockNumbering::InvalidIndex)
+            continue; // not processed yet
+          NewIDom = NewIDom == BlockNumbering::InvalidIndex ? P : Intersect(P, NewIDom);
         }
-        
-        // clear elements that are not in the intersection
-        // ie. does not appear in all sets (count < NPred)
-        for(auto ITMap : AuxMap){
-          if(ITMap.second < NPred){
-            NewSet.erase(ITMap.first);
-          }
-        }  
-
-        // BB must be in this set
-        NewSet.insert(&BB); 
-        // If the se changes, use the new set and go again
-        if(ActualSet != NewSet){
-          dom[&BB] = NewSet;
+        Stats.SetCompares++;
+        if(IDom[I] != NewIDom){
+          IDom[I] = NewIDom;
+          Stats.Changes++;
           changed = true;
         }
       }
     }
+    IDom[RPO.front()] = BlockNumbering::InvalidIndex;
+}
+
+// Adds the counters of one function to the -stats totals.
+static void updateStatistics(const DataflowStats &Stats){
+    NumFunctions++;
+    NumSweeps += Stats.Sweeps;
+    NumBlockVisits += Stats.BlockVisits;
+    NumChanges += Stats.Changes;
+    NumSetInsertions += Stats.SetInsertions;
+    NumSetErasures += Stats.SetErasures;
+    NumSetCompares += Stats.SetCompares;
+}
+
+void ResultDominators::computeOnGraph(const CFGSnapshot &CFG,
+                                      ArrayRef<unsigned> RPO){
+    dropNCDTable();
+    Dom.clear();
+    IDom.assign(CFG.size(), BlockNumbering::InvalidIndex);
+    Stats = DataflowStats();
+    if(RPO.empty()){
+      DFSIn.assign(CFG.size(), BlockNumbering::InvalidIndex);
+      DFSOut.assign(CFG.size(), BlockNumbering::InvalidIndex);
+      return;
+    }
+
+    // The solver also provides the reachable predecessor lists by node
+    // number, so both algorithms only touch dense arrays.
+    Optional<PhaseTimer> Timer;
+    Timer.emplace(Stats.InitTime);
+    DataflowSolver<DataflowDirection::Forward> Solver(CFG, RPO);
+    Timer.reset();
+
+    if(Algorithm == DomAlgorithm::Sets){
+      computeDominatorSets(*this, Solver, RPO);
+    } else {
+      computeIDoms(*this, Solver, RPO);
+    }
+
+    Timer.emplace(Stats.ExpansionTime);
+    computeDFSNumbers(RPO.front());
+}
+
+// Computes the dominators of the function described by Info from scratch.
+static void computeDominators(ResultDominators &res, const FunctionInfo &Info){
+    res.Numbering = Info.Numbering;
+    res.computeOnGraph(Info.CFG, Info.RPO);
+}
+
+// Cache entries hold the block count and the idom array; the dominator
+// sets and the DFS numbering are rebuilt from the tree.
+static void writeCachedDominators(const ResultDominators &res, raw_ostream &OS){
+    support::endian::Writer W(OS, support::little);
+    W.write<uint32_t>(res.Numbering.size());
+    for(unsigned I : res.IDom)
+      W.write<uint32_t>(I);
+}
+
+static bool readCachedDominators(ResultDominators &res, StringRef Data){
+    CacheEntryReader Reader(Data);
+    uint32_t NumBlocks;
+    if(!Reader.read(NumBlocks) || NumBlocks != res.Numbering.size())
+      return false;
+    res.IDom.resize(NumBlocks);
+    for(unsigned &I : res.IDom){
+      uint32_t V;
+      if(!Reader.read(V) || (V >= NumBlocks && V != BlockNumbering::InvalidIndex))
+        return false;
+      I = V;
+    }
+    if(!Reader.atEnd())
+      return false;
+    res.Stats = DataflowStats();
+    res.Dom.clear();
+    if(NumBlocks == 0){
+      res.DFSIn.clear();
+      res.DFSOut.clear();
+      return true;
+    }
+    res.computeDFSNumbers();
+
+    if(res.Algorithm == DomAlgorithm::Sets){
+      // A block's idom precedes it in DFS order, so the sets can be built
+      // top-down. Unreachable blocks are dominated only by themselves.
+      std::vector<unsigned> Order;
+      res.Dom.assign(NumBlocks, DenseBitSet(NumBlocks));
+      for(unsigned I = 0; I != NumBlocks; I++){
+        res.Dom[I].set(I);
+        if(res.DFSIn[I] != BlockNumbering::InvalidIndex)
+          Order.push_back(I);
+      }
+      llvm::sort(Order, [&](unsigned A, unsigned B){
+        return res.DFSIn[A] < res.DFSIn[B];
+      });
+      for(unsigned I : Order){
+        if(res.IDom[I] != BlockNumbering::InvalidIndex)
+          res.Dom[I].unionWith(res.Dom[res.IDom[I]]);
+      }
+    }
+    return true;
+}
 
+ResultDominators DominatorsAnalysis::runOnFunction(Function &F){
+    Optional<FunctionInfo> Info;
+    return compute(F, [&]() -> const FunctionInfo & {
+      if(!Info)
+        Info.emplace(F);
+      return *Info;
+    });
+}
+
+ResultDominators DominatorsAnalysis::runOnFunction(Function &F,
+                                                   const FunctionInfo &Info){
+    return compute(F, [&]() -> const FunctionInfo & { return Info; });
+}
+
+ResultDominators DominatorsAnalysis::compute(
+    Function &F, function_ref<const FunctionInfo &()> GetInfo){
+    ResultDominators res;
+    res.Algorithm = Algorithm;
+    std::string Key;
+    if(Cache){
+      Key = AnalysisCache::getKey(F, "dom");
+      res.Numbering = BlockNumbering(F);
+      if(Cache->lookup(Key, [&](StringRef Data){
+           return readCachedDominators(res, Data);
+         })){
+        NumCachedFunctions++;
+        return res;
+      }
+    }
+    computeDominators(res, GetInfo());
+    updateStatistics(res.Stats);
+    if(Cache)
+      Cache->store(Key, [&](raw_ostream &OS){ writeCachedDominators(res, OS); });
     return res;
 }
 
+void ResultDominators::computeDFSNumbers(unsigned Root){
+    dropNCDTable();
+    unsigned NumBlocks = IDom.size();
+    DFSIn.assign(NumBlocks, BlockNumbering::InvalidIndex);
+    DFSOut.assign(NumBlocks, BlockNumbering::InvalidIndex);
+    if(NumBlocks == 0)
+      return;
+
+    // Children lists of the dominator tree in CSR form.
+    std::vector<unsigned> ChildBegin(NumBlocks + 1, 0);
+    for(unsigned I = 0; I != NumBlocks; I++){
+      if(IDom[I] != BlockNumbering::InvalidIndex)
+        ChildBegin[IDom[I] + 1]++;
+    }
+    for(unsigned I = 0; I != NumBlocks; I++){
+      ChildBegin[I + 1] += ChildBegin[I];
+    }
+    std::vector<unsigned> Children(ChildBegin.back());
+    std::vector<unsigned> Fill(ChildBegin.begin(), ChildBegin.end() - 1);
+    for(unsigned I = 0; I != NumBlocks; I++){
+      if(IDom[I] != BlockNumbering::InvalidIndex)
+        Children[Fill[IDom[I]]++] = I;
+    }
+
+    unsigned Counter = 0;
+    SmallVector<std::pair<unsigned, unsigned>, 32> Stack;
+    DFSIn[Root] = Counter++;
+    Stack.push_back({Root, ChildBegin[Root]});
+    while(!Stack.empty()){
+      unsigned Node = Stack.back().first;
+      unsigned &Next = Stack.back().second;
+      if(Next == ChildBegin[Node + 1]){
+        DFSOut[Node] = Counter++;
+        Stack.pop_back();
+        continue;
+      }
+      unsigned Child = Children[Next++];
+      DFSIn[Child] = Counter++;
+      Stack.push_back({Child, ChildBegin[Child]});
+    }
+}
+
 bool ResultDominators::invalidate(
     Function &F, const PreservedAnalyses &PA,
     FunctionAnalysisManager::Invalidator &Inv) {
       
   auto PAC = PA.getChecker<DominatorsAnalysis>();
-  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>());
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>() ||
+           PAC.preservedSet<CFGAnalyses>());
 }
 
-const BBPtrSet& ResultDominators::getBBDominators(const llvm::BasicBlock* BB) const{
-    auto &domSet = dom.find(BB)->second;
- 
-    return domSet;
+// Walks up from A until it dominates B, both being reachable. Used by the
+// incremental updates, which only need a few answers per batch and would
+// not amortize building the table.
+static unsigned walkToCommonDominator(const ResultDominators &res, unsigned A,
+                                      unsigned B){
+    while(!res.dominates(A, B))
+      A = res.IDom[A];
+    return A;
 }
 
-  const Dominators::const_iterator ResultDominators::dominatorsBegin() const{
-    return begin(dom);
-  }
+void ResultDominators::buildNCDTable() const {
+    const unsigned Invalid = BlockNumbering::InvalidIndex;
+    if(!NCDPos.empty() || IDom.empty())
+      return;
+    // DFSIn counts entries and exits together; gather the blocks by it.
+    unsigned NumBlocks = IDom.size(), MaxIn = 0;
+    for(unsigned In : DFSIn){
+      if(In != Invalid)
+        MaxIn = std::max(MaxIn, In);
+    }
+    std::vector<unsigned> ByIn(MaxIn + 1, Invalid);
+    for(unsigned B = 0; B != NumBlocks; B++){
+      if(DFSIn[B] != Invalid)
+        ByIn[DFSIn[B]] = B;
+    }
+    NCDPos.assign(NumBlocks, Invalid);
+    for(unsigned B : ByIn){
+      if(B != Invalid){
+        NCDPos[B] = NCDOrder.size();
+        NCDOrder.push_back(B);
+      }
+    }
 
-  const Dominators::const_iterator ResultDominators::dominatorsEnd() const {
-    return end(dom);
-  }
+    unsigned Size = NCDOrder.size();
+    unsigned Levels = Log2_32(Size) + 1;
+    NCDMin.resize(size_t(Levels) * Size);
+    for(unsigned I = 0; I != Size; I++){
+      unsigned Parent = IDom[NCDOrder[I]];
+      NCDMin[I] = Parent == Invalid ? 0 : NCDPos[Parent] + 1;
+    }
+    for(unsigned J = 1; J != Levels; J++){
+      const unsigned *Prev = &NCDMin[size_t(J - 1) * Size];
+      unsigned *Cur = &NCDMin[size_t(J) * Size];
+      unsigned Half = 1u << (J - 1);
+      for(unsigned I = 0; I + 2 * Half <= Size; I++)
+        Cur[I] = std::min(Prev[I], Prev[I + Half]);
+    }
+}
+
+// For blocks A and B at DFS positions PA < PB, the blocks at positions
+// PA + 1 to PB all lie below their nearest common dominator, and one of
+// them is its child. The smallest idom position among them is therefore
+// the one of the answer; a root in the range means different trees.
+unsigned ResultDominators::findNearestCommonDominator(unsigned A, unsigned B) const {
+    const unsigned Invalid = BlockNumbering::InvalidIndex;
+    if(A == B)
+      return A;
+    buildNCDTable();
+    unsigned PA = NCDPos[A], PB = NCDPos[B];
+    if(PA == Invalid || PB == Invalid)
+      return Invalid;
+    if(PA > PB)
+      std::swap(PA, PB);
+    unsigned Size = NCDOrder.size();
+    unsigned J = Log2_32(PB - PA);
+    const unsigned *Level = &NCDMin[size_t(J) * Size];
+    unsigned Min = std::min(Level[PA + 1], Level[PB + 1 - (1u << J)]);
+    return Min == 0 ? Invalid : NCDOrder[Min - 1];
+}
+
+const BasicBlock *
+ResultDominators::findNearestCommonDominator(const BasicBlock *A,
+                                             const BasicBlock *B) const {
+    unsigned IdxA = Numbering.getIndex(A), IdxB = Numbering.getIndex(B);
+    if(IdxA == BlockNumbering::InvalidIndex || IdxB == BlockNumbering::InvalidIndex)
+      return nullptr;
+    unsigned NCD = findNearestCommonDominator(IdxA, IdxB);
+    return NCD == BlockNumbering::InvalidIndex ? nullptr : Numbering.getBlock(NCD);
+}
+
+void ResultDominators::findNearestCommonDominators(
+    ArrayRef<std::pair<unsigned, unsigned>> Pairs,
+    MutableArrayRef<unsigned> Results) const {
+    assert(Pairs.size() == Results.size() && "one result per pair");
+    buildNCDTable();
+    for(unsigned I = 0; I != Pairs.size(); I++)
+      Results[I] = findNearestCommonDominator(Pairs[I].first, Pairs[I].second);
+}
+
+// Recomputes the dominator subtree rooted at Root after edges inside it
+// changed. Reachable blocks outside the subtree only enter it through
+// Root, so neither Root nor the blocks outside are affected, and the
+// subtree can be solved as a CFG of its own with Root as entry. Returns
+// false without touching the result if a block of the subtree is no longer
+// reachable from Root, or if an edge enters the subtree elsewhere.
+static bool updateSubtree(ResultDominators &res, unsigned Root){
+    const BlockNumbering &Numbering = res.Numbering;
+    const unsigned Invalid = BlockNumbering::InvalidIndex;
+    unsigned SubtreeSize = (res.DFSOut[Root] - res.DFSIn[Root] + 1) / 2;
+    // Uses the old DFS numbering, which is only rewritten at the end.
+    auto InSubtree = [&](unsigned B){
+      return res.DFSIn[B] != Invalid && res.dominates(Root, B);
+    };
+
+    // Reverse post-order of the subtree from Root, without leaving it.
+    DenseMap<unsigned, unsigned> Pos;
+    std::vector<unsigned> RPO;
+    RPO.reserve(SubtreeSize);
+    SmallVector<std::pair<unsigned, const_succ_iterator>, 32> Stack;
+    Pos[Root] = 0;
+    Stack.push_back({Root, succ_begin(Numbering.getBlock(Root))});
+    while(!Stack.empty()){
+      unsigned BB = Stack.back().first;
+      const_succ_iterator &It = Stack.back().second;
+      if(It == succ_end(Numbering.getBlock(BB))){
+        RPO.push_back(BB);
+        Stack.pop_back();
+        continue;
+      }
+      unsigned Succ = Numbering.getIndex(*It++);
+      if(Succ == Invalid)
+        return false;
+      if(InSubtree(Succ) && Pos.insert({Succ, 0}).second)
+        Stack.push_back({Succ, succ_begin(Numbering.getBlock(Succ))});
+    }
+    if(RPO.size() != SubtreeSize)
+      return false;
+    std::reverse(RPO.begin(), RPO.end());
+    for(unsigned I = 0; I != RPO.size(); I++)
+      Pos[RPO[I]] = I;
+
+    // Predecessors by RPO position. Edges from unreachable blocks are
+    // ignored, as in the full computation.
+    std::vector<SmallVector<unsigned, 2>> Preds(RPO.size());
+    for(unsigned I = 1; I != RPO.size(); I++){
+      for(const BasicBlock *PredBB : predecessors(Numbering.getBlock(RPO[I]))){
+        unsigned P = Numbering.getIndex(PredBB);
+        if(P == Invalid)
+          return false;
+        auto It = Pos.find(P);
+        if(It != Pos.end())
+          Preds[I].push_back(It->second);
+        else if(res.DFSIn[P] != Invalid)
+          return false;
+      }
+    }
+
+    // Cooper-Harvey-Kennedy over the subtree, on RPO positions.
+    std::vector<unsigned> NewIDom(RPO.size(), Invalid);
+    NewIDom[0] = 0;
+    auto Intersect = [&](unsigned A, unsigned B){
+      while(A != B){
+        while(A > B) A = NewIDom[A];
+        while(B > A) B = NewIDom[B];
+      }
+      return A;
+    };
+    bool changed = true;
+    while(changed){
+      changed = false;
+      for(unsigned I = 1; I != RPO.size(); I++){
+        unsigned New = Invalid;
+        for(unsigned P : Preds[I]){
+          if(NewIDom[P] == Invalid)
+            continue;
+          New = New == Invalid ? P : Intersect(P, New);
+        }
+        if(NewIDom[I] != New){
+          NewIDom[I] = New;
+          changed = true;
+        }
+      }
+    }
+
+    // Write back. An idom precedes its blocks in RPO, so dominator sets can
+    // be rebuilt top-down from the tree.
+    for(unsigned I = 1; I != RPO.size(); I++){
+      unsigned B = RPO[I];
+      res.IDom[B] = RPO[NewIDom[I]];
+      if(res.Algorithm == DomAlgorithm::Sets){
+        res.Dom[B] = res.Dom[res.IDom[B]];
+        res.Dom[B].set(B);
+      }
+    }
+
+    // Renumber the subtree inside the DFS interval of Root, which keeps its
+    // size since the subtree has the same blocks.
+    std::vector<unsigned> ChildBegin(RPO.size() + 1, 0);
+    for(unsigned I = 1; I != RPO.size(); I++)
+      ChildBegin[NewIDom[I] + 1]++;
+    for(unsigned I = 0; I != RPO.size(); I++)
+      ChildBegin[I + 1] += ChildBegin[I];
+    std::vector<unsigned> Children(ChildBegin.back());
+    std::vector<unsigned> Fill(ChildBegin.begin(), ChildBegin.end() - 1);
+    for(unsigned I = 1; I != RPO.size(); I++)
+      Children[Fill[NewIDom[I]]++] = I;
+
+    unsigned Counter = res.DFSIn[Root] + 1;
+    SmallVector<std::pair<unsigned, unsigned>, 32> DFSStack;
+    DFSStack.push_back({0, ChildBegin[0]});
+    while(!DFSStack.empty()){
+      unsigned Node = DFSStack.back().first;
+      unsigned &Next = DFSStack.back().second;
+      if(Next == ChildBegin[Node + 1]){
+        if(Node != 0)
+          res.DFSOut[RPO[Node]] = Counter++;
+        DFSStack.pop_back();
+        continue;
+      }
+      unsigned Child = Children[Next++];
+      res.DFSIn[RPO[Child]] = Counter++;
+      DFSStack.push_back({Child, ChildBegin[Child]});
+    }
+    assert(Counter == res.DFSOut[Root] && "subtree changed size");
+    return true;
+}
+
+void ResultDominators::applyUpdates(ArrayRef<DominatorTree::UpdateType> Updates){
+    if(Updates.empty() || Numbering.size() == 0)
+      return;
+    const unsigned Invalid = BlockNumbering::InvalidIndex;
+
+    // Block numbers only stay valid while the block list does not change.
+    const Function &F = *Numbering.getBlock(0)->getParent();
+    unsigned Root = Invalid;
+    bool Recompute = F.size() != Numbering.size();
+    for(const DominatorTree::UpdateType &U : Updates){
+      if(Recompute)
+        break;
+      unsigned From = Numbering.getIndex(U.getFrom());
+      unsigned To = Numbering.getIndex(U.getTo());
+      if(From == Invalid || To == Invalid){
+        Recompute = true;
+        break;
+      }
+      // Edges leaving unreachable blocks do not affect dominance, and an
+      // edge into an unreachable block makes a part of the CFG reachable.
+      if(DFSIn[From] == Invalid)
+        continue;
+      if(DFSIn[To] == Invalid){
+        Recompute = true;
+        break;
+      }
+      unsigned NCD = walkToCommonDominator(*this, From, To);
+      Root = Root == Invalid ? NCD : walkToCommonDominator(*this, Root, NCD);
+    }
+
+    if(!Recompute && (Root == Invalid || updateSubtree(*this, Root))){
+      dropNCDTable();
+      NumIncrementalUpdates++;
+    } else {
+      NumFallbackUpdates++;
+      recalculate();
+    }
+
+    if(VerifyDomUpdates && !verify())
+      report_fatal_error("incremental dominator update diverged from a full "
+                         "recompute");
+}
+
+void ResultDominators::recalculate(){
+    if(Numbering.size() == 0)
+      return;
+    computeDominators(*this, FunctionInfo(*Numbering.getBlock(0)->getParent()));
+}
+
+void ResultDominators::recalculate(const FunctionInfo &Info){
+    computeDominators(*this, Info);
+}
 
+bool ResultDominators::verify() const {
+    if(Numbering.size() == 0)
+      return true;
+    const Function &F = *Numbering.getBlock(0)->getParent();
+    ResultDominators Fresh;
+    Fresh.Algorithm = Algorithm;
+    computeDominators(Fresh, FunctionInfo(F));
+
+    if(Fresh.Numbering.blocks() != Numbering.blocks()){
+      errs() << "DominatorsAnalysis: block list of " << F.getName()
+             << " changed without a recompute\n";
+      return false;
+    }
+
+    bool OK = true;
+    for(unsigned B = 0; B != Numbering.size(); B++){
+      bool Same = IDom[B] == Fresh.IDom[B] &&
+                  (DFSIn[B] == BlockNumbering::InvalidIndex) ==
+                      (Fresh.DFSIn[B] == BlockNumbering::InvalidIndex);
+      if(Algorithm == DomAlgorithm::Sets)
+        Same = Same && Dom[B] == Fresh.Dom[B];
+      // The DFS numbers may differ in child order, but must nest.
+      if(IDom[B] != BlockNumbering::InvalidIndex)
+        Same = Same && DFSIn[IDom[B]] < DFSIn[B] && DFSOut[B] < DFSOut[IDom[B]];
+      if(!Same){
+        errs() << "DominatorsAnalysis: dominators of "
+               << getValueName(*Numbering.getBlock(B)) << " in " << F.getName()
+               << " differ from a full recompute\n";
+        OK = false;
+      }
+    }
+    return OK;
+}
+
+DominatorSetView ResultDominators::getBBDominators(const llvm::BasicBlock* BB) const{
+    return DominatorSetView(*this, Numbering.getIndex(BB));
+}
+
+const BasicBlock *ResultDominators::getIDom(const BasicBlock *BB) const {
+    unsigned Idx = Numbering.getIndex(BB);
+    if(Idx == BlockNumbering::InvalidIndex || IDom[Idx] == BlockNumbering::InvalidIndex)
+      return nullptr;
+    return Numbering.getBlock(IDom[Idx]);
+}
+
+bool ResultDominators::isReachable(const BasicBlock *BB) const {
+    unsigned Idx = Numbering.getIndex(BB);
+    return Idx != BlockNumbering::InvalidIndex && DFSIn[Idx] != BlockNumbering::InvalidIndex;
+}
+
+bool ResultDominators::dominates(const BasicBlock *A, const BasicBlock *B) const {
+    unsigned IdxA = Numbering.getIndex(A), IdxB = Numbering.getIndex(B);
+    if(IdxA == BlockNumbering::InvalidIndex || IdxB == BlockNumbering::InvalidIndex)
+      return false;
+    return dominates(IdxA, IdxB);
+}
+
+// Whether the edge Start -> End dominates UseBB: End must dominate it, and
+// every other way into End must come from below End.
+static bool dominatesEdge(const ResultDominators &res, const BasicBlock *Start,
+                          const BasicBlock *End, const BasicBlock *UseBB){
+    if(!res.dominates(End, UseBB))
+      return false;
+    if(End->getSinglePredecessor())
+      return true;
+    bool SeenStart = false;
+    for(const BasicBlock *Pred : predecessors(End)){
+      if(Pred == Start){
+        // Two edges from Start, such as a switch with equal cases.
+        if(SeenStart)
+          return false;
+        SeenStart = true;
+        continue;
+      }
+      if(!res.dominates(End, Pred))
+        return false;
+    }
+    return true;
+}
+
+// The destination a result defined by Def flows to, for terminators that
+// define one.
+static const BasicBlock *getResultDest(const Instruction *Def){
+    if(auto *Invoke = dyn_cast<InvokeInst>(Def))
+      return Invoke->getNormalDest();
+    if(auto *CallBr = dyn_cast<CallBrInst>(Def))
+      return CallBr->getDefaultDest();
+    return nullptr;
+}
+
+bool ResultDominators::dominates(const Value *DefV, const Use &U) const {
+    const Instruction *Def = dyn_cast<Instruction>(DefV);
+    if(!Def)
+      return true;
+    const Instruction *User = cast<Instruction>(U.getUser());
+    const BasicBlock *DefBB = Def->getParent();
+    const BasicBlock *UseBB = User->getParent();
+    if(auto *PHI = dyn_cast<PHINode>(User))
+      UseBB = PHI->getIncomingBlock(U);
+    if(!isReachable(UseBB))
+      return true;
+    if(!isReachable(DefBB))
+      return false;
+    if(const BasicBlock *Dest = getResultDest(Def)){
+      // A PHI of the destination using the result along the edge itself.
+      if(User->getParent() == Dest && UseBB == DefBB)
+        return true;
+      return dominatesEdge(*this, DefBB, Dest, UseBB);
+    }
+    if(DefBB != UseBB)
+      return dominates(DefBB, UseBB);
+    // PHIs use their values at the end of the incoming block.
+    if(isa<PHINode>(User))
+      return true;
+    return Def->comesBefore(User);
+}
+
+bool ResultDominators::dominates(const Value *DefV, const Instruction *User) const {
+    const Instruction *Def = dyn_cast<Instruction>(DefV);
+    if(!Def)
+      return true;
+    const BasicBlock *DefBB = Def->getParent();
+    const BasicBlock *UseBB = User->getParent();
+    if(!isReachable(UseBB))
+      return true;
+    if(!isReachable(DefBB))
+      return false;
+    if(Def == User)
+      return false;
+    // Results of terminators and PHIs are compared at the start of the
+    // block of User, which a definition in the same block comes after.
+    const BasicBlock *Dest = getResultDest(Def);
+    if(Dest || isa<PHINode>(User)){
+      if(DefBB == UseBB)
+        return false;
+      return Dest ? dominatesEdge(*this, DefBB, Dest, UseBB)
+                  : dominates(DefBB, UseBB);
+    }
+    if(DefBB != UseBB)
+      return dominates(DefBB, UseBB);
+    return Def->comesBefore(User);
+}
+
+bool DominatorSetView::contains(const BasicBlock *BB) const {
+  unsigned Idx = Result.Numbering.getIndex(BB);
+  if(empty() || Idx == BlockNumbering::InvalidIndex)
+    return false;
+  if(Result.Algorithm == DomAlgorithm::Sets)
+    return Result.Dom[BlockIdx].test(Idx);
+  return Result.dominates(Idx, BlockIdx);
+}
+
+unsigned DominatorSetView::size() const {
+  if(empty())
+    return 0;
+  if(Result.Algorithm == DomAlgorithm::Sets)
+    return Result.Dom[BlockIdx].count();
+  unsigned N = 0;
+  for(unsigned I = BlockIdx; I != BlockNumbering::InvalidIndex; I = Result.IDom[I])
+    N++;
+  return N;
+}
+
+DominatorSetView::iterator DominatorSetView::begin() const {
+  if(empty())
+    return end();
+  if(Result.Algorithm == DomAlgorithm::Sets)
+    return iterator(Result, BlockIdx, Result.Dom[BlockIdx].findFirst());
+  return iterator(Result, BlockIdx, BlockIdx);
+}
+
+const BasicBlock *DominatorSetView::iterator::operator*() const {
+  return Result->Numbering.getBlock(Idx);
+}
+
+DominatorSetView::iterator &DominatorSetView::iterator::operator++() {
+  // Sets mode walks the set bits, IDom mode walks up the tree.
+  if(Result->Algorithm == DomAlgorithm::Sets){
+    Idx = Result->Dom[BlockIdx].findNext(Idx);
+  } else {
+    unsigned Parent = Result->IDom[Idx];
+    Idx = Parent == BlockNumbering::InvalidIndex ? -1 : static_cast<int>(Parent);
+  }
+  return *this;
+}
 
 // Legacy PM implementation
 bool LegacyDominatorsAnalysis::runOnFunction(Function &F) {
@@ -142,7 +829,8 @@ bool LegacyDominatorsAnalysis::runOnFunction(Function &F) {
 }
 
 void LegacyDominatorsAnalysis::print(raw_ostream &OutS, Module const *) const {
-  printDominatorsResult(OutS, dom);
+  printDominatorSets(OutS, dom, OutputFormat::Text, "DominatorsAnalysis",
+                     "dominators");
 }
 
 
@@ -151,8 +839,12 @@ PreservedAnalyses
 DominatorsAnalysisPrinter::run(Function &M,
                               FunctionAnalysisManager &MAM) {
 
-  auto Dominators = MAM.getResult<DominatorsAnalysis>(M);
-  printDominatorsResult(OS, Dominators);
+  ResultDominators Computed;
+  const ResultDominators &Dominators = getCachedResultOr(
+      DominatorsAnalysis(Algorithm), M, MAM, Computed,
+      [&](const ResultDominators &R) { return R.Algorithm == Algorithm; });
+  printDominatorSets(OS, Dominators, Format, "DominatorsAnalysis",
+                     "dominators");
   return PreservedAnalyses::all();
 }
 
@@ -162,6 +854,28 @@ DominatorsAnalysisPrinter::run(Function &M,
 //-----------------------------------------------------------------------------
 AnalysisKey DominatorsAnalysis::Key;
 
+// Accepts "print<Prefix>", "print<Prefix<sets>>" and "print<Prefix<idom>>",
+// where Prefix is dom or postdom.
+static bool parseDomPrinterName(StringRef Name, StringRef Prefix,
+                                DomAlgorithm &Algorithm) {
+  if (!Name.consume_front("print<") || !Name.consume_front(Prefix) ||
+      !Name.consume_back(">"))
+    return false;
+  if (Name.empty()) {
+    Algorithm = DomAlgorithm::Sets;
+    return true;
+  }
+  if (Name == "<sets>") {
+    Algorithm = DomAlgorithm::Sets;
+    return true;
+  }
+  if (Name == "<idom>") {
+    Algorithm = DomAlgorithm::IDom;
+    return true;
+  }
+  return false;
+}
+
 llvm::PassPluginLibraryInfo getDominatorsAnalysisPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "dom", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
@@ -169,8 +883,17 @@ llvm::PassPluginLibraryInfo getDominatorsAnalysisPluginInfo() {
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, FunctionPassManager &FPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "print<dom>") {
-                    FPM.addPass(DominatorsAnalysisPrinter(llvm::errs()));
+                  DomAlgorithm Algorithm;
+                  if (parseDomPrinterName(Name, "dom", Algorithm)) {
+                    FPM.addPass(DominatorsAnalysisPrinter(llvm::errs(), Algorithm));
+                    return true;
+                  }
+                  if (parseDomPrinterName(Name, "postdom", Algorithm)) {
+                    FPM.addPass(PostDominatorsAnalysisPrinter(llvm::errs(), Algorithm));
+                    return true;
+                  }
+                  if (Name == "print<df>") {
+                    FPM.addPass(DominanceFrontiersAnalysisPrinter(llvm::errs()));
                     return true;
                   }
                   return false;
@@ -179,6 +902,11 @@ llvm::PassPluginLibraryInfo getDominatorsAnalysisPluginInfo() {
             PB.registerAnalysisRegistrationCallback(
                 [](FunctionAnalysisManager &MAM) {
                   MAM.registerPass([&] { return DominatorsAnalysis(); });
+                  MAM.registerPass([&] { return PostDominatorsAnalysis(); });
+                  MAM.registerPass([&] { return DominanceFrontiersAnalysis(); });
+                  // Shared with the other analyses of this tool; the first
+                  // registration wins.
+                  MAM.registerPass([&] { return FunctionInfoAnalysis(); });
                 });
           }};    
           
@@ -215,20 +943,43 @@ static RegisterPass<LegacyDominatorsAnalysis>
 //------------------------------------------------------------------------------
 // Helper functions
 //------------------------------------------------------------------------------
-static void printDominatorsResult(llvm::raw_ostream &OutS,
-                         const ResultDominators &dominators){ 
- 
-    auto IT = dominators.dominatorsBegin();
-    auto ITE = dominators.dominatorsEnd();    
-
-    for(; IT != ITE; IT++){
-      auto BB = IT->first;
-      auto DomSet = IT->second;
-      OutS << "(DominatorsAnalysis) Basic Block "<< BB->getNameOrAsOperand() << "{ ";
-      for(auto DomBB : DomSet){
-        OutS << DomBB->getNameOrAsOperand() << " ";
+void llvm::printDominatorSets(llvm::raw_ostream &OutS,
+                              const ResultDominators &dominators,
+                              OutputFormat Format, StringRef Tag,
+                              StringRef Key){
+
+    const BlockNumbering &Numbering = dominators.Numbering;
+    if(Numbering.size() == 0)
+      return;
+    const Function &F = *Numbering.getBlock(0)->getParent();
+    ValueNameCache Names(F);
+    SmallVector<unsigned, 16> DomIdx;
+    for(auto BB : dominators.blocks()){
+      // Print in layout order whatever order the view enumerates in.
+      DomIdx.clear();
+      for(auto DomBB : dominators.getBBDominators(BB)){
+        DomIdx.push_back(Numbering.getIndex(DomBB));
+      }
+      llvm::sort(DomIdx);
+
+      if(Format == OutputFormat::JSONLines){
+        json::OStream J(OutS);
+        J.object([&] {
+          J.attribute("function", F.getName());
+          J.attribute("block", Names.get(*BB));
+          J.attributeArray(Key, [&] {
+            for(unsigned Idx : DomIdx)
+              J.value(Names.get(*Numbering.getBlock(Idx)));
+          });
+        });
+        OutS << "\n";
+        continue;
+      }
+
+      OutS << "(" << Tag << ") Basic Block "<< Names.get(*BB) << "{ ";
+      for(unsigned Idx : DomIdx){
+        OutS << Names.get(*Numbering.getBlock(Idx)) << " ";
       }
       OutS << "}\n";
     }
-                         
-}
\ No newline at end of file
+}
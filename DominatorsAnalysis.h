@@ -13,43 +13,214 @@
 #ifndef LLVM_DOMINATORSANALYSIS_H
 #define LLVM_DOMINATORSANALYSIS_H
 
-#include "llvm/ADT/MapVector.h"
+#include "BitSet.h"
+#include "BlockNumbering.h"
+#include "DataflowSolver.h"
+#include "FunctionInfo.h"
+#include "ValueNames.h"
+
 #include "llvm/IR/AbstractCallSite.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <vector>
+
 //------------------------------------------------------------------------------
 // New PM interface
 //------------------------------------------------------------------------------
 namespace llvm{
 
-using BBPtrSet = llvm::SmallPtrSet<const llvm::BasicBlock*, 8>;
-using Dominators = llvm::MapVector<const llvm::BasicBlock *, BBPtrSet>;
+// Selects how the dominator information is computed:
+//  * Sets - iterative data-flow over bit-vector dominator sets. Stores the
+//           full dominator set of every block (O(N^2) memory).
+//  * IDom - Cooper-Harvey-Kennedy iterative immediate-dominator algorithm
+//           over reverse post-order. Stores only the idom array (O(N)).
+enum class DomAlgorithm { Sets, IDom };
+
+class AnalysisCache;
+struct ResultDominators;
+
+// Lightweight read-only view over the dominator set of a single block. It
+// does not own any storage and is invalidated with the result it refers to.
+// In IDom mode the set is enumerated by walking up the dominator tree, from
+// the block itself to the entry block.
+class DominatorSetView {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = const BasicBlock *;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const BasicBlock *const *;
+    using reference = const BasicBlock *;
+
+    iterator(const ResultDominators &Result, unsigned BlockIdx, int Idx)
+        : Result(&Result), BlockIdx(BlockIdx), Idx(Idx) {}
+
+    const BasicBlock *operator*() const;
+    iterator &operator++();
+    bool operator==(const iterator &RHS) const { return Idx == RHS.Idx; }
+    bool operator!=(const iterator &RHS) const { return Idx != RHS.Idx; }
 
+  private:
+    const ResultDominators *Result;
+    unsigned BlockIdx;
+    int Idx;
+  };
+
+  DominatorSetView(const ResultDominators &Result, unsigned BlockIdx)
+      : Result(Result), BlockIdx(BlockIdx) {}
+
+  bool contains(const BasicBlock *BB) const;
+  unsigned size() const;
+  bool empty() const { return BlockIdx == BlockNumbering::InvalidIndex; }
+
+  iterator begin() const;
+  iterator end() const { return iterator(Result, BlockIdx, -1); }
+
+private:
+  const ResultDominators &Result;
+  unsigned BlockIdx;
+};
 
 struct ResultDominators {
-public:  
-  Dominators dom;    
+public:
+  DomAlgorithm Algorithm = DomAlgorithm::Sets;
+  BlockNumbering Numbering;
+  // Dom[I] is the dominator set of block I, indexed by block number. Only
+  // populated in Sets mode.
+  std::vector<DenseBitSet> Dom;
+  // Dominator tree, populated in both modes. IDom[I] is the immediate
+  // dominator of block I, or InvalidIndex for the entry block and for
+  // unreachable blocks. DFSIn/DFSOut are the pre/post visit numbers of a
+  // DFS over the tree, so that A dominates B iff B's interval is nested in
+  // A's interval.
+  std::vector<unsigned> IDom;
+  std::vector<unsigned> DFSIn;
+  std::vector<unsigned> DFSOut;
+  // Convergence and phase timings of the fixed point that produced this
+  // result.
+  DataflowStats Stats;
 
+  // The result is kept when DominatorsAnalysis or the CFG is preserved. A
+  // pass that edits the CFG can keep it alive by calling applyUpdates and
+  // preserving DominatorsAnalysis.
   bool invalidate(Function &F, const PreservedAnalyses &PA,
                     FunctionAnalysisManager::Invalidator &Inv);
 
-  const BBPtrSet& getBBDominators(const llvm::BasicBlock* BB) const;
-  const Dominators::const_iterator dominatorsBegin() const;
-  const Dominators::const_iterator dominatorsEnd() const;
-  
+  // Incrementally updates the result after edges were inserted or deleted,
+  // in the style of DomTreeUpdater: the CFG must already reflect Updates.
+  // Only the dominator subtree rooted at the nearest common dominator of
+  // the updated edges is recomputed. Falls back to recalculate() when the
+  // edits make unreachable blocks reachable or vice versa, or when blocks
+  // were added to or removed from the function.
+  void applyUpdates(ArrayRef<DominatorTree::UpdateType> Updates);
+  // Recomputes the whole result from scratch, optionally from the facts
+  // of the current function when they are at hand.
+  void recalculate();
+  void recalculate(const FunctionInfo &Info);
+  // Compares the result against a from-scratch computation and returns
+  // true if they agree. Applied after every update with -verify-dom-updates.
+  bool verify() const;
+
+  // Returns an empty set for blocks that are not part of the function.
+  DominatorSetView getBBDominators(const llvm::BasicBlock* BB) const;
+  ArrayRef<const BasicBlock *> blocks() const { return Numbering.blocks(); }
+
+  // Returns nullptr for the entry block and for unreachable blocks.
+  const BasicBlock *getIDom(const BasicBlock *BB) const;
+  bool isReachable(const BasicBlock *BB) const;
+  // O(1) query on the DFS numbering of the dominator tree. Every block
+  // dominates itself; other than that, unreachable blocks neither dominate
+  // nor are dominated by anything.
+  bool dominates(const BasicBlock *A, const BasicBlock *B) const;
+  bool dominates(unsigned A, unsigned B) const {
+    if (A == B)
+      return true;
+    if (DFSIn[A] == BlockNumbering::InvalidIndex ||
+        DFSIn[B] == BlockNumbering::InvalidIndex)
+      return false;
+    return DFSIn[A] <= DFSIn[B] && DFSOut[B] <= DFSOut[A];
+  }
+  // Instruction-level queries with the semantics of llvm::DominatorTree:
+  // a PHI uses its incoming value at the end of the incoming block, the
+  // result of an invoke or callbr is only available along the edge to its
+  // normal destination, and uses in unreachable blocks are dominated by
+  // everything. Arguments and constants dominate every use. Instructions
+  // of the same block are ordered with Instruction::comesBefore.
+  bool dominates(const Value *Def, const Use &U) const;
+  bool dominates(const Value *Def, const Instruction *User) const;
+
+  // Nearest common dominator by block number: A itself when A == B, and
+  // InvalidIndex when the blocks are in different trees or either one is
+  // unreachable. Constant time on a sparse table of range minima over the
+  // blocks in DFS order, built by the first query in O(N log N) and dropped
+  // when the tree changes. Building it makes the first query unsafe to
+  // call concurrently on the same result; buildNCDTable() builds it ahead.
+  unsigned findNearestCommonDominator(unsigned A, unsigned B) const;
+  // Returns nullptr where the above returns InvalidIndex, and for blocks
+  // that are not part of the function.
+  const BasicBlock *findNearestCommonDominator(const BasicBlock *A,
+                                               const BasicBlock *B) const;
+  // Answers the query of every pair of Pairs into the same slot of Results.
+  void findNearestCommonDominators(
+      ArrayRef<std::pair<unsigned, unsigned>> Pairs,
+      MutableArrayRef<unsigned> Results) const;
+  void buildNCDTable() const;
+
+  // Solves the dominator problem of an arbitrary graph from the entry
+  // RPO.front(), filling every member but Numbering. Nodes missing from RPO
+  // are unreachable. The function CFG and the reversed CFG of the
+  // post-dominators both go through here.
+  void computeOnGraph(const CFGSnapshot &CFG, ArrayRef<unsigned> RPO);
+  // Builds the DFS numbering from IDom, starting at the tree root.
+  void computeDFSNumbers(unsigned Root = 0);
+
+private:
+  // The table of findNearestCommonDominator: the reachable blocks in DFS
+  // order, the position of every block in it, and level J of the minima
+  // at NCDMin[J * NCDOrder.size()]. The level 0 entry of a block is one
+  // more than the position of its idom, or 0 for a root.
+  mutable std::vector<unsigned> NCDOrder;
+  mutable std::vector<unsigned> NCDPos;
+  mutable std::vector<unsigned> NCDMin;
+  void dropNCDTable() {
+    NCDOrder.clear();
+    NCDPos.clear();
+    NCDMin.clear();
+  }
 };
 
+// Pretty-prints the set of every block of Result, in layout order, as
+// "(Tag) Basic Block <name>{ <blocks> }" lines or as JSON objects with the
+// blocks under Key. Shared by the dominators and post-dominators printers.
+void printDominatorSets(raw_ostream &OS, const ResultDominators &Result,
+                        OutputFormat Format, StringRef Tag, StringRef Key);
+
 class DominatorsAnalysis : public AnalysisInfoMixin<DominatorsAnalysis> {
 public:
   using Result = ResultDominators;
 
+  // Results are looked up in and added to Cache when one is given. Cached
+  // results carry no convergence counters or timings.
+  explicit DominatorsAnalysis(DomAlgorithm Algorithm = DomAlgorithm::Sets,
+                              AnalysisCache *Cache = nullptr)
+      : Algorithm(Algorithm), Cache(Cache) {}
+
+  // Uses the FunctionInfo cached by AM, computing it if needed.
   Result run(Function &F, FunctionAnalysisManager &AM);
   Result runOnFunction(Function &F);
+  Result runOnFunction(Function &F, const FunctionInfo &Info);
 private:
+  Result compute(Function &F, function_ref<const FunctionInfo &()> GetInfo);
+
+  DomAlgorithm Algorithm;
+  AnalysisCache *Cache;
+
   // A special type used by analysis passes to provide an address that
   // identifies that particular analysis pass type.
   static llvm::AnalysisKey Key;
@@ -79,11 +250,16 @@ private:
 class DominatorsAnalysisPrinter
     : public llvm::PassInfoMixin<DominatorsAnalysisPrinter> {
 public:
-  explicit DominatorsAnalysisPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  explicit DominatorsAnalysisPrinter(
+      llvm::raw_ostream &OutS, DomAlgorithm Algorithm = DomAlgorithm::Sets,
+      OutputFormat Format = OutputFormat::Text)
+      : OS(OutS), Algorithm(Algorithm), Format(Format) {}
   PreservedAnalyses run(Function &M, FunctionAnalysisManager &MAM);
 
 private:
   llvm::raw_ostream &OS;
+  DomAlgorithm Algorithm;
+  OutputFormat Format;
 };
 
 
@@ -0,0 +1,280 @@
+//========================================================================
+// FILE:
+//    DominatorsUpdateTest.cpp
+//
+// DESCRIPTION:
+//    Tests ResultDominators::applyUpdates. The CFGs of the analysis-bench
+//    shapes and of the given modules, such as those written by llvm-stress,
+//    are edited by retargeting branches, and every batch of edge insertions
+//    and deletions is applied to the result and checked against a full
+//    recompute with verify(). Hand-written batches cover the update of the
+//    subtree under the nearest common dominator, batches that change which
+//    blocks are reachable, and the recompute when blocks are added or
+//    erased. When LLVM statistics are enabled, the path taken by each of
+//    those batches is checked as well.
+//
+// USAGE:
+//      <BUILD/DIR>/dominators-update-test [<module> ...]
+//
+// License: MIT
+//========================================================================
+#include "CFGShapes.h"
+#include "DominatorsAnalysis.h"
+#include "TestSupport.h"
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <random>
+
+using namespace llvm;
+
+using UpdateType = DominatorTree::UpdateType;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory TestCategory{"test options"};
+
+static cl::list<std::string> InputModules{
+    cl::Positional, cl::desc("<modules whose CFGs are edited>"),
+    cl::ZeroOrMore, cl::cat{TestCategory}};
+
+static cl::opt<unsigned> Batches{
+    "batches", cl::desc("Number of random update batches per function."),
+    cl::init(200), cl::cat{TestCategory}};
+
+//===----------------------------------------------------------------------===//
+// Checks
+//===----------------------------------------------------------------------===//
+enum class UpdatePath { Any, Incremental, Fallback };
+
+// Applies Updates, whose edits the CFG must already reflect, and checks the
+// result against a full recompute and the path the batch took.
+static void applyAndVerify(ResultDominators &Res, ArrayRef<UpdateType> Updates,
+                           UpdatePath Expected, const Twine &What) {
+  unsigned Incremental = getStatistic("dom.NumIncrementalUpdates");
+  unsigned Fallback = getStatistic("dom.NumFallbackUpdates");
+  Res.applyUpdates(Updates);
+  check(Res.verify(), What + ": verify");
+#if LLVM_ENABLE_STATS
+  if (Expected == UpdatePath::Incremental)
+    check(getStatistic("dom.NumIncrementalUpdates") == Incremental + 1,
+          What + ": expected an incremental update");
+  if (Expected == UpdatePath::Fallback)
+    check(getStatistic("dom.NumFallbackUpdates") == Fallback + 1,
+          What + ": expected a full recompute");
+#else
+  (void)Incremental;
+  (void)Fallback;
+#endif
+}
+
+// The nearest common dominators of all pairs, which are answered from a
+// table that the updates must drop, against a result computed from scratch.
+static void checkNCD(const ResultDominators &Res, DomAlgorithm Algorithm,
+                     Function &F, const Twine &What) {
+  ResultDominators Fresh = DominatorsAnalysis(Algorithm).runOnFunction(F);
+  bool Same = true;
+  for (const BasicBlock &A : F)
+    for (const BasicBlock &B : F)
+      Same = Same && Res.findNearestCommonDominator(&A, &B) ==
+                         Fresh.findNearestCommonDominator(&A, &B);
+  check(Same, What + ": nearest common dominators");
+}
+
+//===----------------------------------------------------------------------===//
+// CFG edits
+//===----------------------------------------------------------------------===//
+// Points successor S of T to New and records the edges that appeared or
+// disappeared; a terminator may reach a block more than once.
+static void setSuccessor(Instruction *T, unsigned S, BasicBlock *New,
+                         std::vector<UpdateType> &Updates) {
+  BasicBlock *From = T->getParent();
+  BasicBlock *Old = T->getSuccessor(S);
+  if (Old == New)
+    return;
+  bool HadNew = is_contained(successors(From), New);
+  T->setSuccessor(S, New);
+  if (!is_contained(successors(From), Old))
+    Updates.push_back({DominatorTree::Delete, From, Old});
+  if (!HadNew)
+    Updates.push_back({DominatorTree::Insert, From, New});
+}
+
+// Replaces the unconditional branch of From by a conditional branch to its
+// old target and To.
+static void addEdge(BasicBlock *From, BasicBlock *To,
+                    std::vector<UpdateType> &Updates) {
+  auto *Br = cast<BranchInst>(From->getTerminator());
+  BasicBlock *Old = Br->getSuccessor(0);
+  BranchInst::Create(Old, To, ConstantInt::getTrue(From->getContext()), Br);
+  Br->eraseFromParent();
+  Updates.push_back({DominatorTree::Insert, From, To});
+}
+
+// Undoes addEdge.
+static void removeEdge(BasicBlock *From, std::vector<UpdateType> &Updates) {
+  auto *Br = cast<BranchInst>(From->getTerminator());
+  BasicBlock *To = Br->getSuccessor(1);
+  BranchInst::Create(Br->getSuccessor(0), Br);
+  Br->eraseFromParent();
+  Updates.push_back({DominatorTree::Delete, From, To});
+}
+
+//===----------------------------------------------------------------------===//
+// Tests
+//===----------------------------------------------------------------------===//
+// Hand-written batches on entry -> b1 -> ... -> b8.
+static void testChainEdits(DomAlgorithm Algorithm) {
+  LLVMContext Ctx;
+  Module M("chain", Ctx);
+  Function *F = buildChain(M, 8);
+  std::vector<BasicBlock *> BBs;
+  for (BasicBlock &BB : *F)
+    BBs.push_back(&BB);
+  BasicBlock *Entry = BBs[0];
+  ResultDominators Res = DominatorsAnalysis(Algorithm).runOnFunction(*F);
+  // Answered from the table, which the updates must drop.
+  check(Res.findNearestCommonDominator(BBs[5], BBs[7]) == BBs[5],
+        "chain: nearest common dominator before the updates");
+
+  // b2 -> b5 only changes the subtree of b2.
+  std::vector<UpdateType> Updates;
+  addEdge(BBs[2], BBs[5], Updates);
+  applyAndVerify(Res, Updates, UpdatePath::Incremental, "chain: insert b2->b5");
+  check(Res.getIDom(BBs[5]) == BBs[2], "chain: idom of b5 after the insert");
+  check(Res.findNearestCommonDominator(BBs[4], BBs[5]) == BBs[2],
+        "chain: nearest common dominator after the insert");
+  checkNCD(Res, Algorithm, *F, "chain: insert b2->b5");
+
+  Updates.clear();
+  removeEdge(BBs[2], Updates);
+  applyAndVerify(Res, Updates, UpdatePath::Incremental, "chain: delete b2->b5");
+  check(Res.getIDom(BBs[5]) == BBs[4], "chain: idom of b5 after the delete");
+
+  // entry -> b4 cuts b1 to b3 off, and entry -> b1 brings them back.
+  Updates.clear();
+  setSuccessor(Entry->getTerminator(), 0, BBs[4], Updates);
+  applyAndVerify(Res, Updates, UpdatePath::Fallback,
+                 "chain: b1 to b3 unreachable");
+  check(!Res.isReachable(BBs[2]) && Res.getIDom(BBs[4]) == Entry,
+        "chain: blocks cut off");
+  checkNCD(Res, Algorithm, *F, "chain: b1 to b3 unreachable");
+
+  // Edges leaving unreachable blocks do not change anything.
+  Updates.clear();
+  addEdge(BBs[2], BBs[7], Updates);
+  applyAndVerify(Res, Updates, UpdatePath::Incremental,
+                 "chain: insert from an unreachable block");
+  Updates.clear();
+  removeEdge(BBs[2], Updates);
+  applyAndVerify(Res, Updates, UpdatePath::Incremental,
+                 "chain: delete from an unreachable block");
+
+  Updates.clear();
+  setSuccessor(Entry->getTerminator(), 0, BBs[1], Updates);
+  applyAndVerify(Res, Updates, UpdatePath::Fallback,
+                 "chain: b1 to b3 reachable again");
+  check(Res.isReachable(BBs[2]) && Res.getIDom(BBs[4]) == BBs[3],
+        "chain: blocks reachable again");
+
+  // Splitting b2 -> b3 adds a block the numbering does not know.
+  BasicBlock *Split = BasicBlock::Create(Ctx, "split", F, BBs[3]);
+  BranchInst::Create(BBs[3], Split);
+  Updates.clear();
+  setSuccessor(BBs[2]->getTerminator(), 0, Split, Updates);
+  Updates.push_back({DominatorTree::Insert, Split, BBs[3]});
+  applyAndVerify(Res, Updates, UpdatePath::Fallback, "chain: split b2->b3");
+  check(Res.getIDom(BBs[3]) == Split && Res.getIDom(Split) == BBs[2],
+        "chain: idoms around the new block");
+
+  // Erasing it again; the edges of the erased block are left out.
+  Updates.clear();
+  setSuccessor(BBs[2]->getTerminator(), 0, BBs[3], Updates);
+  Split->eraseFromParent();
+  Updates.erase(remove_if(Updates,
+                          [&](const UpdateType &U) {
+                            return U.getFrom() == Split || U.getTo() == Split;
+                          }),
+                Updates.end());
+  applyAndVerify(Res, Updates, UpdatePath::Fallback, "chain: erase the split");
+  check(Res.getIDom(BBs[3]) == BBs[2], "chain: idom of b3 after the erase");
+  checkNCD(Res, Algorithm, *F, "chain: erase the split");
+}
+
+// Random batches of one to three retargeted successors.
+static void testRandomEdits(Function &F, DomAlgorithm Algorithm,
+                            std::mt19937 &Rand) {
+  if (F.isDeclaration() || F.size() < 2)
+    return;
+  std::vector<BasicBlock *> BBs;
+  for (BasicBlock &BB : F)
+    BBs.push_back(&BB);
+  ResultDominators Res = DominatorsAnalysis(Algorithm).runOnFunction(F);
+  StringRef Name = F.getName();
+  for (unsigned I = 0; I != Batches; I++) {
+    std::vector<UpdateType> Updates;
+    for (unsigned K = 0, E = 1 + Rand() % 3; K != E; K++) {
+      Instruction *T = BBs[Rand() % BBs.size()]->getTerminator();
+      if (T->getNumSuccessors() == 0)
+        continue;
+      unsigned S = Rand() % T->getNumSuccessors();
+      // The entry block cannot have predecessors.
+      setSuccessor(T, S, BBs[1 + Rand() % (BBs.size() - 1)], Updates);
+    }
+    applyAndVerify(Res, Updates, UpdatePath::Any, Name + ": random batch");
+    if (I % 16 == 0)
+      checkNCD(Res, Algorithm, F, Name + ": random batch");
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  cl::HideUnrelatedOptions(TestCategory);
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Tests the incremental dominator updates\n");
+  llvm_shutdown_obj SDO;
+  // Statistics are only collected once enabled, and tell which path an
+  // update batch took.
+  EnableStatistics(/*DoPrintOnExit=*/false);
+
+  std::mt19937 Rand(42);
+  for (DomAlgorithm Algorithm : {DomAlgorithm::Sets, DomAlgorithm::IDom}) {
+    testChainEdits(Algorithm);
+
+    // Every shape gets its own module: the edits break its PHIs.
+    std::function<Function *(Module &)> Shapes[] = {
+        [](Module &M) { return buildChain(M, 60); },
+        [](Module &M) { return buildLoopNest(M, 8); },
+        [](Module &M) { return buildIrreducible(M, 12); },
+        [](Module &M) { return buildSwitch(M, 30); },
+        [](Module &M) { return buildManyValues(M, 20); },
+    };
+    for (auto &Build : Shapes) {
+      LLVMContext Ctx;
+      Module M("shape", Ctx);
+      testRandomEdits(*Build(M), Algorithm, Rand);
+    }
+
+    for (const std::string &Path : InputModules) {
+      LLVMContext Ctx;
+      SMDiagnostic Err;
+      std::unique_ptr<Module> M = parseIRFile(Path, Err, Ctx);
+      if (!M) {
+        Err.print(Argv[0], errs());
+        return 1;
+      }
+      for (Function &F : *M)
+        testRandomEdits(F, Algorithm, Rand);
+    }
+  }
+
+  return reportChecks();
+}
@@ -0,0 +1,26 @@
+//=============================================================================
+// FILE:
+//    FunctionInfo.cpp
+//
+// DESCRIPTION:
+//    Builds the per-function facts shared by the analyses.
+//
+// License: MIT
+//=============================================================================
+#include "FunctionInfo.h"
+
+using namespace llvm;
+
+AnalysisKey FunctionInfoAnalysis::Key;
+
+FunctionInfo::FunctionInfo(const Function &F)
+    : Numbering(F), Values(F), CFG(Numbering) {
+    if(Numbering.size() != 0)
+      RPO = CFG.reversePostOrder(0);
+}
+
+bool FunctionInfo::invalidate(Function &F, const PreservedAnalyses &PA,
+                              FunctionAnalysisManager::Invalidator &Inv) {
+    auto PAC = PA.getChecker<FunctionInfoAnalysis>();
+    return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>());
+}
@@ -0,0 +1,83 @@
+//========================================================================
+// FILE:
+//    FunctionInfo.h
+//
+// DESCRIPTION:
+//    Per-function facts shared by the analyses: the block and value
+//    numberings, a CSR snapshot of the CFG (see CFGSnapshot), and the
+//    reverse post-order of the reachable blocks. FunctionInfoAnalysis
+//    computes them once per function, so running DominatorsAnalysis and
+//    LivenessAnalysis on the same function walks the CFG and the
+//    instructions only once.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_ANALYSIS_FUNCTIONINFO_H
+#define LLVM_ANALYSIS_FUNCTIONINFO_H
+
+#include "BlockNumbering.h"
+#include "CFGSnapshot.h"
+#include "ValueNumbering.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+
+#include <vector>
+
+namespace llvm {
+
+struct FunctionInfo {
+  explicit FunctionInfo(const Function &F);
+
+  BlockNumbering Numbering;
+  ValueNumbering Values;
+  CFGSnapshot CFG;
+  // Reachable blocks in reverse post-order, starting with the entry block.
+  // Successors are visited in terminator order.
+  std::vector<unsigned> RPO;
+
+  ArrayRef<unsigned> successors(unsigned B) const { return CFG.successors(B); }
+  ArrayRef<unsigned> predecessors(unsigned B) const {
+    return CFG.predecessors(B);
+  }
+
+  // Only kept when FunctionInfoAnalysis or all analyses are preserved: the
+  // value numbering depends on the instructions, not just the CFG.
+  bool invalidate(Function &F, const PreservedAnalyses &PA,
+                  FunctionAnalysisManager::Invalidator &Inv);
+};
+
+class FunctionInfoAnalysis : public AnalysisInfoMixin<FunctionInfoAnalysis> {
+public:
+  using Result = FunctionInfo;
+
+  Result run(Function &F, FunctionAnalysisManager &AM) {
+    return FunctionInfo(F);
+  }
+
+private:
+  static AnalysisKey Key;
+  friend struct AnalysisInfoMixin<FunctionInfoAnalysis>;
+};
+
+// Returns the cached result of AnalysisT on F if Matches accepts it, and
+// otherwise the one Analysis computes into Storage, which is not cached.
+// The printers use it so that a variant other than the registered one is
+// built once, off the cached per-function facts, instead of after the
+// registered variant.
+template <typename AnalysisT, typename MatchT>
+const typename AnalysisT::Result &
+getCachedResultOr(AnalysisT Analysis, Function &F,
+                  FunctionAnalysisManager &FAM,
+                  typename AnalysisT::Result &Storage, MatchT Matches) {
+  if (const auto *Cached = FAM.getCachedResult<AnalysisT>(F))
+    if (Matches(*Cached))
+      return *Cached;
+  Storage = Analysis.run(F, FAM);
+  return Storage;
+}
+
+} // End namespace llvm
+
+#endif // LLVM_ANALYSIS_FUNCTIONINFO_H
@@ -0,0 +1,372 @@
+//=============================================================================
+// FILE:
+//    InterferenceGraphAnalysis.cpp
+//
+// DESCRIPTION:
+//    Builds the interference graph of the values of a function from the
+//    live-out sets of LivenessAnalysis. Registered by the LivenessAnalysis
+//    plugin.
+//
+// USAGE:
+//    New PM printer
+//      opt -load-pass-plugin=libLivenessAnalysis.dylib `\`
+//        -passes="print<interference>" -disable-output <input-llvm-file>
+//
+// License: MIT
+//=============================================================================
+#include "InterferenceGraphAnalysis.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/Support/JSON.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "interference"
+
+STATISTIC(NumFunctions, "Number of functions analyzed");
+STATISTIC(NumEdges, "Number of interference edges");
+STATISTIC(NumMatrices, "Number of graphs stored as a bit matrix");
+STATISTIC(NumHints, "Number of copy-coalescing hints");
+
+AnalysisKey InterferenceGraphAnalysis::Key;
+
+static unsigned getPairIndex(unsigned A, unsigned B){
+    if(A < B)
+      std::swap(A, B);
+    return A * (A - 1) / 2 + B;
+}
+
+// The operand a copy-like instruction moves into its result, or nullptr.
+static const Value *getMoveSource(const Instruction &I, const DataLayout &DL){
+    if(auto *Cast = dyn_cast<CastInst>(&I)){
+      if(Cast->isNoopCast(DL))
+        return Cast->getOperand(0);
+    }
+    return nullptr;
+}
+
+// A value defined by an instruction interferes with every value live right
+// after it, except the source of a copy, which holds the same bits. The
+// arguments are defined together on entry and interfere with the values
+// live there. Calls Edge(Def, V) for each such pair. The live set is kept
+// as a sparse set so that it can be enumerated at every definition in time
+// proportional to its size.
+template <typename EdgeFn>
+static void walkInterference(const Function &F,
+                             const ResultLivenessAnalysis &Liveness,
+                             EdgeFn Edge){
+    const unsigned Invalid = BlockNumbering::InvalidIndex;
+    const BlockNumbering &Numbering = Liveness.Numbering;
+    const ValueNumbering &Values = Liveness.Values;
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    std::vector<unsigned> Dense, Pos(Values.size());
+    Dense.reserve(Values.size());
+    auto Contains = [&](unsigned V){
+      return Pos[V] < Dense.size() && Dense[Pos[V]] == V;
+    };
+    auto Add = [&](unsigned V){
+      if(Contains(V))
+        return;
+      Pos[V] = Dense.size();
+      Dense.push_back(V);
+    };
+    auto Remove = [&](unsigned V){
+      if(!Contains(V))
+        return;
+      unsigned Last = Dense.back();
+      Dense[Pos[V]] = Last;
+      Pos[Last] = Pos[V];
+      Dense.pop_back();
+    };
+    auto AddEdges = [&](unsigned Def, unsigned Skip){
+      for(unsigned V : Dense){
+        if(V != Def && V != Skip)
+          Edge(Def, V);
+      }
+    };
+
+    unsigned Entry = F.empty() ? Invalid : Numbering.getIndex(&F.getEntryBlock());
+    for(unsigned B = 0; B != Numbering.size(); B++){
+      const BasicBlock &BB = *Numbering.getBlock(B);
+      Dense.clear();
+      for(unsigned V : Liveness.LiveOut[B])
+        Add(V);
+
+      for(auto RIT = BB.rbegin(); RIT != BB.rend(); RIT++){
+        const Instruction &Inst = *RIT;
+        unsigned Def = Values.getIndex(&Inst);
+        if(Def != Invalid){
+          const Value *Source = getMoveSource(Inst, DL);
+          AddEdges(Def, Source ? Values.getIndex(Source) : Invalid);
+        }
+
+        // PHI operands are live-out of the incoming blocks instead.
+        if(isa<PHINode>(Inst)){
+          Remove(Def);
+          continue;
+        }
+        for(const Use &U : Inst.operands()){
+          unsigned V = Values.getIndex(U.get());
+          if(V != Invalid)
+            Add(V);
+        }
+        if(Def != Invalid)
+          Remove(Def);
+      }
+
+      if(B == Entry){
+        for(const Argument &Arg : F.args())
+          AddEdges(Values.getIndex(&Arg), Invalid);
+      }
+    }
+}
+
+// The hints of the PHIs and copies, in the order of the instructions.
+static void collectHints(ResultInterferenceGraph &res, const Function &F,
+                         const BlockNumbering &Numbering){
+    const unsigned Invalid = BlockNumbering::InvalidIndex;
+    const ValueNumbering &Values = res.Values;
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    for(const BasicBlock *BB : Numbering.blocks()){
+      for(const Instruction &Inst : *BB){
+        unsigned Def = Values.getIndex(&Inst);
+        if(Def == Invalid)
+          continue;
+        if(auto *PHI = dyn_cast<PHINode>(&Inst)){
+          SmallVector<unsigned, 4> Seen;
+          for(const Value *In : PHI->incoming_values()){
+            unsigned V = Values.getIndex(In);
+            if(V == Invalid || V == Def || is_contained(Seen, V))
+              continue;
+            Seen.push_back(V);
+            res.Hints.push_back({Def, V, &Inst});
+          }
+        } else if(const Value *Source = getMoveSource(Inst, DL)){
+          unsigned Src = Values.getIndex(Source);
+          if(Src != Invalid && Src != Def)
+            res.Hints.push_back({Def, Src, &Inst});
+        }
+      }
+    }
+}
+
+// The matrix takes one walk. The lists take two, one to size them and one
+// to fill them, so that no list of pairs is kept besides the result.
+static void computeInterference(ResultInterferenceGraph &res, const Function &F,
+                                const ResultLivenessAnalysis &Liveness,
+                                const InterferenceOptions &Options){
+    res.Stats = DataflowStats();
+    Optional<PhaseTimer> Timer;
+    Timer.emplace(res.Stats.InitTime);
+    res.Values = Liveness.Values;
+    unsigned N = res.Values.size();
+    bool UseMatrix = false;
+    switch(Options.Storage){
+    case InterferenceStorage::Auto:
+        UseMatrix = N <= Options.MatrixMaxNodes &&
+                    N <= InterferenceOptions::MatrixLimit;
+        break;
+    case InterferenceStorage::Matrix:
+        UseMatrix = N <= InterferenceOptions::MatrixLimit;
+        break;
+    case InterferenceStorage::Lists:
+        break;
+    }
+    res.Storage = UseMatrix ? InterferenceStorage::Matrix
+                            : InterferenceStorage::Lists;
+    res.Degree.assign(N, 0);
+    Timer.reset();
+
+    Timer.emplace(res.Stats.ExpansionTime);
+    if(UseMatrix){
+      res.Matrix = DenseBitSet(N < 2 ? 0 : getPairIndex(N - 1, N - 2) + 1);
+      walkInterference(F, Liveness, [&](unsigned A, unsigned B){
+        unsigned Idx = getPairIndex(A, B);
+        if(res.Matrix.test(Idx))
+          return;
+        res.Matrix.set(Idx);
+        res.Degree[A]++;
+        res.Degree[B]++;
+        res.NumEdges++;
+      });
+    } else {
+      std::vector<unsigned> Begin(N + 1, 0);
+      walkInterference(F, Liveness, [&](unsigned A, unsigned B){
+        Begin[A + 1]++;
+        Begin[B + 1]++;
+      });
+      for(unsigned V = 0; V != N; V++)
+        Begin[V + 1] += Begin[V];
+      std::vector<unsigned> Unsorted(Begin[N]), Fill(Begin.begin(), Begin.end() - 1);
+      walkInterference(F, Liveness, [&](unsigned A, unsigned B){
+        Unsorted[Fill[A]++] = B;
+        Unsorted[Fill[B]++] = A;
+      });
+      // The graph is symmetric: going through the lists in node order and
+      // appending each node to the lists of its neighbours sorts them.
+      std::vector<unsigned> Targets(Begin[N]);
+      std::copy(Begin.begin(), Begin.end() - 1, Fill.begin());
+      for(unsigned V = 0; V != N; V++){
+        for(unsigned I = Begin[V]; I != Begin[V + 1]; I++)
+          Targets[Fill[Unsorted[I]]++] = V;
+      }
+      std::vector<unsigned>().swap(Unsorted);
+      std::vector<unsigned>().swap(Fill);
+
+      // A pair is only found twice when each value is defined while the
+      // other is live, which needs a use that its definition does not
+      // dominate. The copies end up next to each other.
+      unsigned Out = 0;
+      for(unsigned V = 0; V != N; V++){
+        unsigned First = Begin[V], Last = Begin[V + 1];
+        Begin[V] = Out;
+        for(unsigned I = First; I != Last; I++){
+          if(I == First || Targets[I] != Targets[I - 1])
+            Targets[Out++] = Targets[I];
+        }
+        res.Degree[V] = Out - Begin[V];
+      }
+      Begin[N] = Out;
+      Targets.resize(Out);
+      res.NumEdges = Out / 2;
+      res.Lists = CSRAdjacency(std::move(Begin), std::move(Targets));
+    }
+    collectHints(res, F, Liveness.Numbering);
+    Timer.reset();
+    res.Stats.Sweeps = UseMatrix ? 1 : 2;
+    res.Stats.BlockVisits = res.Stats.Sweeps * Liveness.Numbering.size();
+    res.Stats.SetInsertions = res.NumEdges;
+}
+
+ResultInterferenceGraph InterferenceGraphAnalysis::run(Function &F,
+                                                       FunctionAnalysisManager &AM){
+    ResultLivenessAnalysis &Liveness = AM.getResult<LivenessAnalysis>(F);
+    if(Liveness.hasPendingUpdates())
+      Liveness.flushUpdates();
+    return runOnFunction(F, Liveness);
+}
+
+ResultInterferenceGraph InterferenceGraphAnalysis::runOnFunction(
+    const Function &F, const ResultLivenessAnalysis &Liveness){
+    ResultInterferenceGraph res;
+    computeInterference(res, F, Liveness, Options);
+    NumFunctions++;
+    NumEdges += res.NumEdges;
+    NumHints += res.Hints.size();
+    if(res.Storage == InterferenceStorage::Matrix)
+      NumMatrices++;
+    return res;
+}
+
+bool ResultInterferenceGraph::invalidate(
+    Function &F, const PreservedAnalyses &PA,
+    FunctionAnalysisManager::Invalidator &Inv) {
+  auto PAC = PA.getChecker<InterferenceGraphAnalysis>();
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>());
+}
+
+bool ResultInterferenceGraph::interferes(unsigned A, unsigned B) const {
+  if (A == B)
+    return false;
+  if (Storage == InterferenceStorage::Matrix)
+    return Matrix.test(getPairIndex(A, B));
+  if (Degree[A] > Degree[B])
+    std::swap(A, B);
+  ArrayRef<unsigned> Neighbors = Lists[A];
+  return std::binary_search(Neighbors.begin(), Neighbors.end(), B);
+}
+
+bool ResultInterferenceGraph::interferes(const Value *A, const Value *B) const {
+  unsigned IA = Values.getIndex(A), IB = Values.getIndex(B);
+  if (IA == BlockNumbering::InvalidIndex || IB == BlockNumbering::InvalidIndex)
+    return false;
+  return interferes(IA, IB);
+}
+
+void ResultInterferenceGraph::forEachNeighbor(
+    unsigned V, function_ref<void(unsigned)> Fn) const {
+  if (Storage == InterferenceStorage::Lists) {
+    for (unsigned W : Lists[V])
+      Fn(W);
+    return;
+  }
+  // Row V holds the lower neighbours; the higher ones are in column V.
+  if (V != 0) {
+    unsigned Row = getPairIndex(V, 0);
+    for (int Idx = Matrix.findNext(int(Row) - 1);
+         Idx != -1 && unsigned(Idx) < Row + V; Idx = Matrix.findNext(Idx))
+      Fn(Idx - Row);
+  }
+  for (unsigned W = V + 1; W < size(); W++) {
+    if (Matrix.test(getPairIndex(W, V)))
+      Fn(W);
+  }
+}
+
+// Interference graph printer implementation
+PreservedAnalyses
+InterferenceGraphAnalysisPrinter::run(Function &F,
+                                      FunctionAnalysisManager &FAM) {
+  const ResultInterferenceGraph &Graph =
+      FAM.getResult<InterferenceGraphAnalysis>(F);
+  const ValueNumbering &Values = Graph.Values;
+  StringRef StorageName =
+      Graph.Storage == InterferenceStorage::Matrix ? "matrix" : "lists";
+
+  ValueNameCache Names(F);
+  for (unsigned V = 0; V != Graph.size(); V++) {
+    const Value *Val = Values.getValue(V);
+    if (!Val)
+      continue;
+    if (Format == OutputFormat::JSONLines) {
+      json::OStream J(OS);
+      J.object([&] {
+        J.attribute("function", F.getName());
+        J.attribute("value", Names.get(*Val));
+        J.attributeArray("interferes", [&] {
+          Graph.forEachNeighbor(
+              V, [&](unsigned W) { J.value(Names.get(*Values.getValue(W))); });
+        });
+      });
+      OS << "\n";
+      continue;
+    }
+
+    OS << "(InterferenceGraphAnalysis) Value " << Names.get(*Val) << "{ ";
+    Graph.forEachNeighbor(
+        V, [&](unsigned W) { OS << Names.get(*Values.getValue(W)) << " "; });
+    OS << "}\n";
+  }
+
+  if (Format == OutputFormat::JSONLines) {
+    json::OStream J(OS);
+    J.object([&] {
+      J.attribute("function", F.getName());
+      J.attribute("nodes", Graph.size());
+      J.attribute("edges", Graph.NumEdges);
+      J.attribute("storage", StorageName);
+      J.attributeArray("copy_hints", [&] {
+        for (const CoalesceHint &H : Graph.Hints) {
+          J.array([&] {
+            J.value(Names.get(*Values.getValue(H.A)));
+            J.value(Names.get(*Values.getValue(H.B)));
+          });
+        }
+      });
+    });
+    OS << "\n";
+    return PreservedAnalyses::all();
+  }
+
+  OS << "(InterferenceGraphAnalysis) Copy hints{ ";
+  for (const CoalesceHint &H : Graph.Hints)
+    OS << Names.get(*Values.getValue(H.A)) << "="
+       << Names.get(*Values.getValue(H.B)) << " ";
+  OS << "}\n";
+  OS << "(InterferenceGraphAnalysis) " << Graph.size() << " values, "
+     << Graph.NumEdges << " edges, " << StorageName << "\n";
+  return PreservedAnalyses::all();
+}
@@ -0,0 +1,116 @@
+//========================================================================
+// FILE:
+//    InterferenceGraphAnalysis.h
+//
+// DESCRIPTION:
+//    Declares the InterferenceGraphAnalysis pass and its printer. Two
+//    values interfere when one is defined while the other is live, which
+//    is found by walking every block once backwards from its live-out set
+//    as LivenessAnalysis computed it. The graph is kept as a triangular bit
+//    matrix for functions with few values and as sorted adjacency lists
+//    otherwise. PHIs and no-op casts are recorded as copy-coalescing hints.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_INTERFERENCEGRAPHANALYSIS_H
+#define LLVM_INTERFERENCEGRAPHANALYSIS_H
+
+#include "CFGSnapshot.h"
+#include "LivenessAnalysis.h"
+
+#include <vector>
+
+namespace llvm {
+
+enum class InterferenceStorage { Auto, Matrix, Lists };
+
+struct InterferenceOptions {
+  // Auto picks the matrix for functions of at most MatrixMaxNodes values.
+  // Matrix is only honoured up to MatrixLimit values.
+  InterferenceStorage Storage = InterferenceStorage::Auto;
+  unsigned MatrixMaxNodes = 4096;
+
+  // Keeps the index of the last pair of the matrix in an unsigned.
+  static constexpr unsigned MatrixLimit = 65536;
+};
+
+// Two values an allocator may assign the same register to, removing the
+// copy Copy: a PHI and one of its incoming values, or a no-op cast and its
+// operand. They may still interfere.
+struct CoalesceHint {
+  unsigned A;
+  unsigned B;
+  const Instruction *Copy;
+};
+
+struct ResultInterferenceGraph {
+  // The nodes are the value numbers of the liveness result the graph was
+  // built from. Retired numbers have no edges.
+  ValueNumbering Values;
+  // Matrix or Lists, never Auto.
+  InterferenceStorage Storage = InterferenceStorage::Lists;
+  // With Matrix, the pair A > B is bit A * (A - 1) / 2 + B.
+  DenseBitSet Matrix;
+  // With Lists, the neighbours of every node by increasing number.
+  CSRAdjacency Lists;
+  std::vector<unsigned> Degree;
+  unsigned NumEdges = 0;
+  // In the order of the instructions, each pair once per copy.
+  std::vector<CoalesceHint> Hints;
+  // Timing of the walk and of building the lists, as the expansion phase.
+  DataflowStats Stats;
+
+  // Only kept when InterferenceGraphAnalysis or all analyses are preserved.
+  bool invalidate(Function &F, const PreservedAnalyses &PA,
+                  FunctionAnalysisManager::Invalidator &Inv);
+
+  unsigned size() const { return Degree.size(); }
+  bool interferes(unsigned A, unsigned B) const;
+  // Returns false for values that are never live, such as constants.
+  bool interferes(const Value *A, const Value *B) const;
+  unsigned getDegree(unsigned V) const { return Degree[V]; }
+  // Calls Fn with the neighbours of V by increasing number.
+  void forEachNeighbor(unsigned V, function_ref<void(unsigned)> Fn) const;
+};
+
+class InterferenceGraphAnalysis
+    : public AnalysisInfoMixin<InterferenceGraphAnalysis> {
+public:
+  using Result = ResultInterferenceGraph;
+
+  explicit InterferenceGraphAnalysis(
+      InterferenceOptions Options = InterferenceOptions())
+      : Options(Options) {}
+
+  // Uses the LivenessAnalysis result cached by AM, computing it if needed.
+  Result run(Function &F, FunctionAnalysisManager &AM);
+  // Builds the graph from the live-out sets of Liveness, computed for F.
+  Result runOnFunction(const Function &F,
+                       const ResultLivenessAnalysis &Liveness);
+
+private:
+  InterferenceOptions Options;
+
+  static AnalysisKey Key;
+  friend struct AnalysisInfoMixin<InterferenceGraphAnalysis>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class InterferenceGraphAnalysisPrinter
+    : public PassInfoMixin<InterferenceGraphAnalysisPrinter> {
+public:
+  explicit InterferenceGraphAnalysisPrinter(
+      raw_ostream &OutS, OutputFormat Format = OutputFormat::Text)
+      : OS(OutS), Format(Format) {}
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM);
+
+private:
+  raw_ostream &OS;
+  OutputFormat Format;
+};
+
+} // End namespace llvm
+
+#endif // LLVM_INTERFERENCEGRAPHANALYSIS_H
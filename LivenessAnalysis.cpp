@@ -12,20 +12,57 @@
 //    2. New PM
 //      opt -load-pass-plugin=libLivenessAnalysis.dylib -passes="dominance" `\`
 //        -disable-output <input-llvm-file>
-//
+//    3. New PM printer, optionally selecting the algorithm (iterative, ssa or
+//       loops)
+//      opt -load-pass-plugin=libLivenessAnalysis.dylib `\`
+//        -passes="print<liveness<ssa>>" -disable-output <input-llvm-file>
 //
 // License: MIT
 //=============================================================================
 #include "LivenessAnalysis.h"
+#include "AnalysisCache.h"
+#include "BitSet.h"
+#include "DataflowSolver.h"
+#include "DominatorsAnalysis.h"
+#include "InterferenceGraphAnalysis.h"
+#include "RegisterPressureAnalysis.h"
+#include "ValueNames.h"
+#include "ValueNumbering.h"
 #include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace llvm;
 
+#define DEBUG_TYPE "liveness"
+
+STATISTIC(NumFunctions, "Number of functions analyzed");
+STATISTIC(NumSweeps, "Number of sweeps to reach the fixed point");
+STATISTIC(NumBlockVisits, "Number of block visits");
+STATISTIC(NumChanges, "Number of block visits that changed a live-out set");
+STATISTIC(NumSetInsertions, "Number of values added to live-out sets");
+STATISTIC(NumSetErasures, "Number of values removed from live-out sets");
+STATISTIC(NumSetCompares, "Number of live-out set comparisons");
+STATISTIC(NumIncrementalUpdates, "Number of update batches applied in place");
+STATISTIC(NumFallbackUpdates, "Number of update batches that recomputed everything");
+STATISTIC(NumRecomputedValues, "Number of live ranges recomputed by updates");
+STATISTIC(NumCachedFunctions, "Number of functions loaded from the result cache");
+STATISTIC(NumIrreducibleFallbacks,
+          "Number of irreducible functions solved iteratively instead of "
+          "along the loop forest");
+
+static cl::opt<bool> VerifyLivenessUpdates(
+    "verify-liveness-updates", cl::init(false), cl::Hidden,
+    cl::desc("Compare the liveness against a full recompute after every "
+             "flush of incremental updates"));
 
 
 
@@ -35,95 +72,775 @@ using namespace llvm;
 
 // This method implements what the pass does
 ResultLivenessAnalysis LivenessAnalysis::run(Function &F, FunctionAnalysisManager &MAM) {
-  return runOnFunction(F);
+  // The shared per-function facts are only computed on a cache miss.
+  return compute(F, [&]() -> const FunctionInfo & {
+    return MAM.getResult<FunctionInfoAnalysis>(F);
+  }, [&]() -> const ResultDominators * {
+    // Only the tree is needed. A Sets-mode result would cost O(N^2) to
+    // build, so the tree is computed from the info unless a cached result
+    // already holds it alone.
+    const ResultDominators *Dom = MAM.getCachedResult<DominatorsAnalysis>(F);
+    return Dom && Dom->Algorithm == DomAlgorithm::IDom ? Dom : nullptr;
+  });
 }
 
-ResultLivenessAnalysis LivenessAnalysis::runOnFunction(Function &F){
-    ResultLivenessAnalysis res;
-    BBLiveOutSet UEVar, VarKill;
-    BBLiveOutSet &LiveOut = res.ResultBBLiveOut;
-    InstLiveOutSet &InstVSet = res.ResultInstLiveOut;
-
-      for (auto &BB : F){
-        auto &BBUEVar = UEVar.insert(std::make_pair(&BB, llvm::SmallPtrSet<const llvm::Value*, 8>())).first->second;
-        auto &BBVarKill = VarKill.insert(std::make_pair(&BB, llvm::SmallPtrSet<const llvm::Value*, 8>())).first->second;
-        LiveOut.insert(std::make_pair(&BB, llvm::SmallPtrSet<const llvm::Value*, 8>()));
-        for(const auto &Inst : BB){
+// Converts a set of value numbers back to Value pointers.
+static void toValueSet(const DenseBitSet &Bits, const ValueNumbering &Values,
+                       ValueSet &Set){
+    Set.clear();
+    for (unsigned V : Bits)
+        Set.insert(Values.getValue(V));
+}
+
+// PHI uses are live-out of the incoming block, not live-in of the PHI's
+// block: PhiUses[B] holds the values that flow along the edges leaving B
+// into the PHIs of its successors.
+static void computePhiUses(const BlockNumbering &Numbering,
+                           const ValueNumbering &Values,
+                           std::vector<DenseBitSet> &PhiUses){
+    for (unsigned B = 0; B != Numbering.size(); B++){
+        for (const PHINode &Phi : Numbering.getBlock(B)->phis()){
+            for (unsigned I = 0, E = Phi.getNumIncomingValues(); I != E; I++){
+                unsigned v = Values.getIndex(Phi.getIncomingValue(I));
+                unsigned Pred = Numbering.getIndex(Phi.getIncomingBlock(I));
+                if (v != BlockNumbering::InvalidIndex && Pred != BlockNumbering::InvalidIndex)
+                    PhiUses[Pred].set(v);
+            }
+        }
+    }
+}
+
+// Local facts of every block, over value numbers: UEVar holds the values
+// used before any definition in the block, PHI operands excluded; VarKill
+// the values defined in it, PHIs included; PhiUses, see computePhiUses.
+struct LocalSets {
+    std::vector<DenseBitSet> UEVar, VarKill, PhiUses;
+};
+
+static void computeLocalSets(const ResultLivenessAnalysis &res, LocalSets &Local){
+    const BlockNumbering &Numbering = res.Numbering;
+    const ValueNumbering &Values = res.Values;
+    unsigned NumBlocks = Numbering.size();
+    unsigned NumValues = Values.size();
+    Local.UEVar.assign(NumBlocks, DenseBitSet(NumValues));
+    Local.VarKill.assign(NumBlocks, DenseBitSet(NumValues));
+    Local.PhiUses.assign(NumBlocks, DenseBitSet(NumValues));
+    computePhiUses(Numbering, Values, Local.PhiUses);
+
+    for (unsigned B = 0; B != NumBlocks; B++){
+        auto &BBUEVar = Local.UEVar[B];
+        auto &BBVarKill = Local.VarKill[B];
+        for(const auto &Inst : *Numbering.getBlock(B)){
             if(!isa<PHINode>(Inst)){
                 for (const Use &U : Inst.operands()) {
-                    Value *v = U.get();
-
-                    if(!BBVarKill.contains(v) && !isa<BasicBlock>(*v) && !isa<GlobalVariable>(*v) && !isa<Constant>(*v)){
-                        BBUEVar.insert(v);
+                    unsigned v = Values.getIndex(U.get());
+                    if(v != BlockNumbering::InvalidIndex && !BBVarKill.test(v)){
+                        BBUEVar.set(v);
                     }
                 }
             } 
-            if(!Inst.user_empty()){
-                BBVarKill.insert(&Inst);
+            unsigned Def = Values.getIndex(&Inst);
+            if(Def != BlockNumbering::InvalidIndex){
+                BBVarKill.set(Def);
             }
         } 
     }  
-    bool changed =  true;
-    while(changed){
-        changed = false;
-        for (const auto &BB : F){
-            // recompute liveout
-            llvm::SmallPtrSet<const llvm::Value*, 8> NewLiveOut;
-            const auto& BBLiveOut = LiveOut[&BB];
-            for(auto IT = succ_begin(&BB); IT != succ_end(&BB); IT++){
-                const auto SuccBB = *IT;
-                const auto& SuccLiveOut = LiveOut[SuccBB];
-                const auto& SuccUEVar = UEVar[SuccBB];
-                const auto& SuccVarKill = VarKill[SuccBB];
-                llvm::SmallPtrSet<const llvm::Value*, 8> TmpLiveOut;
-                for(auto V : SuccLiveOut ){
-                    TmpLiveOut.insert(V);
-                }
-                for(auto V : SuccVarKill ){
-                    TmpLiveOut.erase(V);
-                }
-                for(auto V : SuccUEVar ){
-                    TmpLiveOut.insert(V);
-                }
-                for(auto V : TmpLiveOut){
-                    NewLiveOut.insert(V);
-                }
-            }
-            if(NewLiveOut != BBLiveOut){
-                changed = true;
-                LiveOut[&BB] = NewLiveOut;
+}
+
+// Acc |= the values live-in at block S, except the PHIs of S.
+static void addLiveIn(DenseBitSet &Acc, const ResultLivenessAnalysis &res,
+                      const LocalSets &Local, unsigned S){
+    Acc.unionWithGenKill(Local.UEVar[S], res.LiveOut[S], Local.VarKill[S]);
+}
+
+// Transfer function of the solvers: stores Acc as the live-out set of BB
+// and returns true if it changed.
+static bool replaceLiveOut(ResultLivenessAnalysis &res, unsigned BB,
+                           DenseBitSet &Acc){
+    DataflowStats &Stats = res.Stats;
+    Stats.SetCompares++;
+    if(Acc == res.LiveOut[BB])
+        return false;
+    // Live-out sets only grow.
+    Stats.SetInsertions += Acc.count() - res.LiveOut[BB].count();
+    std::swap(res.LiveOut[BB], Acc);
+    return true;
+}
+
+// Classic iterative dataflow:
+//   LiveOut(B) = PhiUses(B) U
+//                U over successors S of UEVar(S) U (LiveOut(S) - VarKill(S))
+// where UEVar ignores PHI operands and VarKill includes PHI definitions.
+static void computeIterativeLiveOut(ResultLivenessAnalysis &res,
+                                    const FunctionInfo &Info,
+                                    const LocalSets &Local){
+    unsigned NumBlocks = res.Numbering.size();
+    Optional<PhaseTimer> Timer;
+    Timer.emplace(res.Stats.InitTime);
+
+    // Solved backwards in post-order. Unreachable blocks come last since
+    // no reachable block depends on them.
+    std::vector<unsigned> Order(Info.RPO.rbegin(), Info.RPO.rend());
+    std::vector<bool> Reachable(NumBlocks, false);
+    for (unsigned I : Order)
+        Reachable[I] = true;
+    for (unsigned I = 0; I != NumBlocks; I++)
+        if (!Reachable[I])
+            Order.push_back(I);
+
+    DataflowSolver<DataflowDirection::Backward> Solver(Info, Order);
+    Timer.emplace(res.Stats.FixedPointTime);
+
+    DenseBitSet NewLiveOut(res.Values.size());
+    res.Stats += Solver.solve(NewLiveOut,
+        [&](DenseBitSet &Acc, unsigned BB) { Acc = Local.PhiUses[BB]; },
+        [&](DenseBitSet &Acc, unsigned Succ) { addLiveIn(Acc, res, Local, Succ); },
+        [&](unsigned BB, DenseBitSet &Acc) { return replaceLiveOut(res, BB, Acc); });
+}
+
+// Non-iterative liveness for reducible CFGs (Boissinot et al., "Computing
+// Liveness Sets for SSA-Form Programs"). The first pass computes the
+// live-out sets in post-order, ignoring the back edges. In a reducible CFG
+// a value live-in at a loop header, other than its PHIs, was defined
+// outside the loop and is live throughout it, so the second pass adds it
+// to the live-out set of every block of the loop, walking the
+// loop-nesting forest from the outermost loops in. Unreachable blocks are
+// then solved iteratively on their own; no reachable block depends on
+// them.
+//
+// Back edges are the edges whose target dominates their source. Returns
+// false, with the live-out sets untouched, if some other edge goes back in
+// reverse post-order: the CFG is then irreducible.
+static bool computeLoopForestLiveOut(ResultLivenessAnalysis &res,
+                                     const FunctionInfo &Info,
+                                     const ResultDominators &Dom,
+                                     const LocalSets &Local){
+    const unsigned Invalid = BlockNumbering::InvalidIndex;
+    unsigned NumBlocks = res.Numbering.size();
+    ArrayRef<unsigned> RPO = Info.RPO;
+    assert(Dom.Numbering.size() == NumBlocks && "dominators of another function");
+    Optional<PhaseTimer> Timer;
+    Timer.emplace(res.Stats.InitTime);
+
+    std::vector<unsigned> Rank(NumBlocks, Invalid);
+    for (unsigned I = 0; I != RPO.size(); I++)
+        Rank[RPO[I]] = I;
+    BitVector IsHeader(NumBlocks);
+    for (unsigned B : RPO){
+        for (unsigned S : Info.successors(B)){
+            if (Rank[S] > Rank[B])
+                continue;
+            if (!Dom.dominates(S, B))
+                return false;
+            IsHeader.set(S);
+        }
+    }
+
+    // Loop-nesting forest, built from the innermost loops out as in
+    // LoopInfo: the body of the loop of header H is found by walking back
+    // from its latches to H. Blocks already claimed by a loop discovered
+    // earlier belong to an inner loop, whose outermost enclosing loop is
+    // then nested in H. Innermost[B] is the header of the innermost loop
+    // containing B, and Parent[H] the header of the loop enclosing H's.
+    std::vector<unsigned> Innermost(NumBlocks, Invalid);
+    std::vector<unsigned> Parent(NumBlocks, Invalid);
+    SmallVector<unsigned, 32> Worklist;
+    auto IsLatch = [&](unsigned H, unsigned P){
+        return Rank[P] != Invalid && Dom.dominates(H, P);
+    };
+    for (unsigned I = RPO.size(); I-- != 0;){
+        unsigned H = RPO[I];
+        if (!IsHeader.test(H))
+            continue;
+        for (unsigned P : Info.predecessors(H))
+            if (IsLatch(H, P))
+                Worklist.push_back(P);
+        while (!Worklist.empty()){
+            unsigned B = Worklist.pop_back_val();
+            unsigned L = Innermost[B];
+            if (L == Invalid){
+                Innermost[B] = H;
+                if (B == H)
+                    continue;
+                for (unsigned P : Info.predecessors(B))
+                    if (Rank[P] != Invalid)
+                        Worklist.push_back(P);
+                continue;
             }
-        }    
+            while (Parent[L] != Invalid)
+                L = Parent[L];
+            if (L == H)
+                continue;
+            // Continue from the entries of the inner loop.
+            Parent[L] = H;
+            for (unsigned P : Info.predecessors(L))
+                if (Rank[P] != Invalid && !IsLatch(L, P))
+                    Worklist.push_back(P);
+        }
     }
-    // handle phi nodes of BBs that are successors of themselves 
-    for (auto &BB : F){
-        for(const auto &Inst : BB){
-            if(isa<PHINode>(Inst)){
-                for (const Use &U : Inst.operands()) {
-                    Value *v = U.get();
-                    auto *I = dyn_cast<Instruction>(v);
-                    if (I && I->getParent() == &BB) {
-                        LiveOut[&BB].insert(v);
-                    } 
-                }    
+
+    Timer.emplace(res.Stats.FixedPointTime);
+    DataflowStats &Stats = res.Stats;
+    Stats.Sweeps = 2;
+    DenseBitSet Live(res.Values.size());
+
+    // Pass 1: post-order over the CFG without its back edges, in which the
+    // live-in sets of all the successors taken into account are final.
+    for (unsigned I = RPO.size(); I-- != 0;){
+        unsigned B = RPO[I];
+        Live = Local.PhiUses[B];
+        for (unsigned S : Info.successors(B))
+            if (Rank[S] > Rank[B])
+                addLiveIn(Live, res, Local, S);
+        Stats.BlockVisits++;
+        if (replaceLiveOut(res, B, Live))
+            Stats.Changes++;
+    }
+
+    // Pass 2: LoopLive[H] holds the values live throughout the loop of H:
+    // those live-in at H that are not its PHIs, and those live throughout
+    // the enclosing loop. An outer header precedes its inner headers in
+    // reverse post-order.
+    std::vector<unsigned> Slot(NumBlocks, Invalid);
+    std::vector<DenseBitSet> LoopLive;
+    LoopLive.reserve(IsHeader.count());
+    for (unsigned H : RPO){
+        if (!IsHeader.test(H))
+            continue;
+        Slot[H] = LoopLive.size();
+        LoopLive.push_back(Parent[H] == Invalid ? DenseBitSet(res.Values.size())
+                                                : LoopLive[Slot[Parent[H]]]);
+        addLiveIn(LoopLive.back(), res, Local, H);
+    }
+    for (unsigned B : RPO){
+        if (Innermost[B] == Invalid)
+            continue;
+        Live = res.LiveOut[B];
+        Live.unionWith(LoopLive[Slot[Innermost[B]]]);
+        Stats.BlockVisits++;
+        if (replaceLiveOut(res, B, Live))
+            Stats.Changes++;
+    }
+
+    // Unreachable blocks, seeded with the live-in sets of their reachable
+    // successors.
+    std::vector<unsigned> Unreachable;
+    for (unsigned B = 0; B != NumBlocks; B++)
+        if (Rank[B] == Invalid)
+            Unreachable.push_back(B);
+    if (Unreachable.empty())
+        return true;
+    DataflowSolver<DataflowDirection::Backward> Solver(Info, Unreachable);
+    DataflowStats UnreachableStats = Solver.solve(Live,
+        [&](DenseBitSet &Acc, unsigned BB) {
+            Acc = Local.PhiUses[BB];
+            for (unsigned S : Info.successors(BB))
+                if (Rank[S] != Invalid)
+                    addLiveIn(Acc, res, Local, S);
+        },
+        [&](DenseBitSet &Acc, unsigned Succ) { addLiveIn(Acc, res, Local, Succ); },
+        [&](unsigned BB, DenseBitSet &Acc) { return replaceLiveOut(res, BB, Acc); });
+    // Counted as further sweeps of the same problem.
+    Stats += UnreachableStats;
+    return true;
+}
+
+static void markLiveOut(DenseBitSet &LiveOut, unsigned v, DataflowStats &Stats){
+    if (LiveOut.test(v))
+        return;
+    LiveOut.set(v);
+    Stats.SetInsertions++;
+}
+
+// SSA liveness by path exploration (Boissinot et al. / Brandner et al.):
+// every use of a value is walked backwards to the definition, marking the
+// value live-in and live-out along the way. Each block is entered at most
+// once per value, so the cost is proportional to the size of the live
+// ranges rather than to the number of fixed-point sweeps. Relies on the
+// definitions dominating their uses.
+// Marks value v live along every path from its uses back to its definition.
+// LiveInMark[B] == v + 1 iff v was already marked live-in at B. Preds(B)
+// returns the numbers of the predecessors of block B.
+template <typename PredsFnT>
+static void markLiveRange(ResultLivenessAnalysis &res, unsigned v,
+                          std::vector<unsigned> &LiveInMark,
+                          SmallVectorImpl<unsigned> &Worklist,
+                          PredsFnT Preds){
+    const BlockNumbering &Numbering = res.Numbering;
+    std::vector<DenseBitSet> &LiveOut = res.LiveOut;
+    DataflowStats &Stats = res.Stats;
+    const Value *V = res.Values.getValue(v);
+    const BasicBlock *DefBB = isa<Argument>(V)
+        ? &cast<Argument>(V)->getParent()->getEntryBlock()
+        : cast<Instruction>(V)->getParent();
+    unsigned Def = Numbering.getIndex(DefBB);
+    // Unreachable code may use an instruction before, or in, its own
+    // definition. The value is then live-in at its defining block too.
+    bool LiveInAtDef = false;
+
+    // Seed with the blocks where v is live-in.
+    for (const Use &U : V->uses()){
+        auto *User = dyn_cast<Instruction>(U.getUser());
+        if (!User)
+            continue;
+        if (auto *DefInst = dyn_cast<Instruction>(V))
+            if (!isa<PHINode>(User) && User->getParent() == DefBB &&
+                (User == DefInst || User->comesBefore(DefInst)))
+                LiveInAtDef = true;
+        if (auto *Phi = dyn_cast<PHINode>(User)){
+            unsigned Pred = Numbering.getIndex(Phi->getIncomingBlock(U));
+            if (Pred == BlockNumbering::InvalidIndex)
+                continue;
+            markLiveOut(LiveOut[Pred], v, Stats);
+            Worklist.push_back(Pred);
+        } else {
+            Worklist.push_back(Numbering.getIndex(User->getParent()));
+        }
+    }
+
+    // Up and mark.
+    while (!Worklist.empty()){
+        unsigned B = Worklist.pop_back_val();
+        if ((B == Def && !LiveInAtDef) || LiveInMark[B] == v + 1)
+            continue;
+        LiveInMark[B] = v + 1;
+        Stats.BlockVisits++;
+        for (unsigned P : Preds(B)){
+            markLiveOut(LiveOut[P], v, Stats);
+            Worklist.push_back(P);
+        }
+    }
+}
+
+static void computePathExplorationLiveOut(ResultLivenessAnalysis &res,
+                                          const FunctionInfo &Info){
+    // Values are processed one at a time, so a single live-in stamp per
+    // block is enough.
+    std::vector<unsigned> LiveInMark(res.Numbering.size(), 0);
+    SmallVector<unsigned, 32> Worklist;
+    // A single pass over the values; block visits count the live-in marks.
+    res.Stats.Sweeps = 1;
+    PhaseTimer Timer(res.Stats.FixedPointTime);
+
+    for (unsigned v = 0; v != res.Values.size(); v++)
+        markLiveRange(res, v, LiveInMark, Worklist,
+                      [&](unsigned B){ return Info.predecessors(B); });
+}
+
+// Adds the counters of one function to the -stats totals.
+static void updateStatistics(const DataflowStats &Stats){
+    NumFunctions++;
+    NumSweeps += Stats.Sweeps;
+    NumBlockVisits += Stats.BlockVisits;
+    NumChanges += Stats.Changes;
+    NumSetInsertions += Stats.SetInsertions;
+    NumSetErasures += Stats.SetErasures;
+    NumSetCompares += Stats.SetCompares;
+}
+
+// Converts the live-out set of block B, and the live sets of its
+// instructions when they are materialized, back to Value sets.
+static void exportBlock(ResultLivenessAnalysis &res, unsigned B){
+    if (res.MaterializeInstLiveOut){
+        const ValueNumbering &Values = res.Values;
+        toValueSet(res.LiveOut[B], Values, res.ResultBBLiveOut[res.Numbering.getBlock(B)]);
+        InstLiveOutSet &InstVSet = res.ResultInstLiveOut;
+        res.walkBlock(B, [&](const Instruction &Inst, const DenseBitSet &Live){
+            toValueSet(Live, Values, InstVSet[&Inst]);
+        });
+    }
+}
+
+// Computes the liveness of the function described by Info from scratch
+// into res. In LoopForest mode the back edges are taken from Dom, or from
+// a dominator tree built from Info if Dom is null.
+static void computeLiveness(ResultLivenessAnalysis &res, const FunctionInfo &Info,
+                            const ResultDominators *Dom = nullptr){
+    res.Numbering = Info.Numbering;
+    res.Values = Info.Values;
+    res.Stats = DataflowStats();
+    res.ResultBBLiveOut.clear();
+    res.ResultInstLiveOut.clear();
+    unsigned NumBlocks = res.Numbering.size();
+
+    // Liveness is computed on bit vectors over value numbers; the results
+    // are converted back to Value sets at the end if they are materialized.
+    res.LiveOut.assign(NumBlocks, DenseBitSet(res.Values.size()));
+    if (res.Algorithm == LivenessAlgorithm::PathExploration){
+        computePathExplorationLiveOut(res, Info);
+    } else {
+        LocalSets Local;
+        {
+            PhaseTimer Timer(res.Stats.InitTime);
+            computeLocalSets(res, Local);
+        }
+        bool Solved = false;
+        if (res.Algorithm == LivenessAlgorithm::LoopForest){
+            Optional<ResultDominators> OwnDom;
+            if (!Dom){
+                PhaseTimer Timer(res.Stats.InitTime);
+                OwnDom.emplace();
+                OwnDom->Algorithm = DomAlgorithm::IDom;
+                OwnDom->recalculate(Info);
+                Dom = OwnDom.getPointer();
             }
+            Solved = computeLoopForestLiveOut(res, Info, *Dom, Local);
+            if (!Solved)
+                NumIrreducibleFallbacks++;
+        }
+        if (!Solved)
+            computeIterativeLiveOut(res, Info, Local);
+    }
+
+    // Per-instruction sets are rebuilt on demand unless asked for.
+    PhaseTimer Timer(res.Stats.ExpansionTime);
+    for (unsigned B = 0; B != NumBlocks; B++)
+        exportBlock(res, B);
+}
+
+// Cache entries hold the block and value counts followed by the words of
+// every live-out set. All algorithms produce the same sets, so entries
+// are shared between them.
+static void writeCachedLiveness(const ResultLivenessAnalysis &res, raw_ostream &OS){
+    support::endian::Writer W(OS, support::little);
+    W.write<uint32_t>(res.Numbering.size());
+    W.write<uint32_t>(res.Values.size());
+    for (const DenseBitSet &Set : res.LiveOut)
+        for (unsigned I = 0, E = Set.getNumWords(); I != E; ++I)
+            W.write<uint64_t>(Set.getWord(I));
+}
+
+static bool readCachedLiveness(ResultLivenessAnalysis &res, const Function &F,
+                               StringRef Data){
+    res.Numbering = BlockNumbering(F);
+    res.Values = ValueNumbering(F);
+    CacheEntryReader Reader(Data);
+    uint32_t NumBlocks, NumValues;
+    if (!Reader.read(NumBlocks) || NumBlocks != res.Numbering.size() ||
+        !Reader.read(NumValues) || NumValues != res.Values.size())
+        return false;
+    res.LiveOut.assign(NumBlocks, DenseBitSet(NumValues));
+    for (DenseBitSet &Set : res.LiveOut){
+        for (unsigned I = 0, E = Set.getNumWords(); I != E; ++I){
+            uint64_t Word;
+            if (!Reader.read(Word))
+                return false;
+            Set.setWord(I, Word);
         }
     }
-    for (const auto &BB : F){
-        auto BBLiveOut = LiveOut[&BB];
-        for(auto RIT = BB.rbegin(); RIT != BB.rend(); RIT++){
-            const auto& Inst = *RIT;
-            InstVSet[&Inst] = BBLiveOut;
-            for (const Use &U : Inst.operands()) {
-                Value *v = U.get();
-                if(!isa<BasicBlock>(*v) && !isa<GlobalVariable>(*v) && !isa<Constant>(*v)){
-                    BBLiveOut.insert(v);
+    if (!Reader.atEnd())
+        return false;
+    res.Stats = DataflowStats();
+    res.ResultBBLiveOut.clear();
+    res.ResultInstLiveOut.clear();
+    for (unsigned B = 0; B != NumBlocks; B++)
+        exportBlock(res, B);
+    return true;
+}
+
+ResultLivenessAnalysis LivenessAnalysis::runOnFunction(Function &F){
+    Optional<FunctionInfo> Info;
+    return compute(F, [&]() -> const FunctionInfo & {
+        if (!Info)
+            Info.emplace(F);
+        return *Info;
+    }, []() -> const ResultDominators * { return nullptr; });
+}
+
+ResultLivenessAnalysis LivenessAnalysis::runOnFunction(Function &F,
+                                                       const FunctionInfo &Info){
+    return compute(F, [&]() -> const FunctionInfo & { return Info; },
+                   []() -> const ResultDominators * { return nullptr; });
+}
+
+ResultLivenessAnalysis LivenessAnalysis::compute(
+    Function &F, function_ref<const FunctionInfo &()> GetInfo,
+    function_ref<const ResultDominators *()> GetDominators){
+    ResultLivenessAnalysis res;
+    res.Algorithm = Options.Algorithm;
+    res.CachedBlocks = Options.CachedBlocks;
+    res.MaterializeInstLiveOut = Options.MaterializeInstLiveOut;
+    std::string Key;
+    if (AnalysisCache *ResultCache = Options.ResultCache){
+        Key = AnalysisCache::getKey(F, "liveness");
+        if (ResultCache->lookup(Key, [&](StringRef Data){
+                return readCachedLiveness(res, F, Data);
+            })){
+            NumCachedFunctions++;
+            return res;
+        }
+    }
+    const FunctionInfo &Info = GetInfo();
+    computeLiveness(res, Info, Options.Algorithm == LivenessAlgorithm::LoopForest
+                                   ? GetDominators() : nullptr);
+    updateStatistics(res.Stats);
+    if (Options.ResultCache)
+        Options.ResultCache->store(Key, [&](raw_ostream &OS){
+            writeCachedLiveness(res, OS);
+        });
+    return res;
+}
+
+//-----------------------------------------------------------------------------
+// Incremental updates
+//-----------------------------------------------------------------------------
+void ResultLivenessAnalysis::markDirtyOperands(const Instruction *I){
+    for (const Use &U : I->operands()){
+        unsigned v = Values.getIndex(U.get());
+        if (v != BlockNumbering::InvalidIndex)
+            DirtyValues.push_back(v);
+    }
+}
+
+void ResultLivenessAnalysis::notifyInstructionInserted(const Instruction *I){
+    unsigned B = Numbering.getIndex(I->getParent());
+    if (B == BlockNumbering::InvalidIndex || I->isTerminator()){
+        NeedsRecompute = true;
+        return;
+    }
+    if (!I->getType()->isVoidTy()){
+        unsigned v = Values.addValue(I);
+        for (DenseBitSet &Live : LiveOut)
+            Live.resize(Values.size());
+        DirtyValues.push_back(v);
+    }
+    markDirtyOperands(I);
+    DirtyBlocks.push_back(B);
+}
+
+void ResultLivenessAnalysis::notifyInstructionErased(const Instruction *I){
+    unsigned B = Numbering.getIndex(I->getParent());
+    if (B == BlockNumbering::InvalidIndex || I->isTerminator()){
+        NeedsRecompute = true;
+        return;
+    }
+    markDirtyOperands(I);
+    // Retire the number right away: the memory of I may be reused by an
+    // instruction inserted later.
+    unsigned v = Values.getIndex(I);
+    if (v != BlockNumbering::InvalidIndex){
+        Values.removeValue(I);
+        RetiredValues.push_back(v);
+    }
+    if (MaterializeInstLiveOut)
+        ResultInstLiveOut.erase(I);
+    DirtyBlocks.push_back(B);
+}
+
+void ResultLivenessAnalysis::notifyUseChanged(const Instruction *User,
+                                              const Value *OldValue){
+    unsigned B = Numbering.getIndex(User->getParent());
+    if (B == BlockNumbering::InvalidIndex){
+        NeedsRecompute = true;
+        return;
+    }
+    unsigned Old = Values.getIndex(OldValue);
+    if (Old != BlockNumbering::InvalidIndex)
+        DirtyValues.push_back(Old);
+    markDirtyOperands(User);
+    DirtyBlocks.push_back(B);
+}
+
+void ResultLivenessAnalysis::flushUpdates(){
+    if (!hasPendingUpdates())
+        return;
+    Cache.clear();
+    Uncached = CachedBlock();
+    if (NeedsRecompute){
+        NumFallbackUpdates++;
+        computeLiveness(*this, FunctionInfo(*Numbering.getBlock(0)->getParent()));
+    } else {
+        NumIncrementalUpdates++;
+        unsigned NumBlocks = Numbering.size();
+        BitVector Touched(NumBlocks);
+        for (unsigned B : DirtyBlocks)
+            Touched.set(B);
+        auto ClearColumn = [&](unsigned v){
+            for (unsigned B = 0; B != NumBlocks; B++){
+                if (LiveOut[B].test(v)){
+                    LiveOut[B].reset(v);
+                    Touched.set(B);
                 }
             }
-            BBLiveOut.erase(&Inst);
+        };
+
+        for (unsigned v : RetiredValues)
+            ClearColumn(v);
+
+        // Recompute the live range of every dirty value from its current
+        // uses; values erased after they became dirty are skipped.
+        llvm::sort(DirtyValues);
+        DirtyValues.erase(std::unique(DirtyValues.begin(), DirtyValues.end()),
+                          DirtyValues.end());
+        std::vector<unsigned> LiveInMark(NumBlocks, 0);
+        SmallVector<unsigned, 32> Worklist;
+        for (unsigned v : DirtyValues){
+            if (!Values.getValue(v))
+                continue;
+            ClearColumn(v);
+            NumRecomputedValues++;
+            // The CFG is unchanged, but the result does not keep the
+            // predecessor lists, so they come from the IR.
+            markLiveRange(*this, v, LiveInMark, Worklist, [&](unsigned B){
+                return map_range(predecessors(Numbering.getBlock(B)),
+                                 [&](const BasicBlock *Pred){
+                                     return Numbering.getIndex(Pred);
+                                 });
+            });
+            for (unsigned B = 0; B != NumBlocks; B++)
+                if (LiveOut[B].test(v))
+                    Touched.set(B);
         }
-    }    
-    return res;
+
+        for (unsigned B : Touched.set_bits())
+            exportBlock(*this, B);
+    }
+
+    DirtyValues.clear();
+    RetiredValues.clear();
+    DirtyBlocks.clear();
+    NeedsRecompute = false;
+
+    if (VerifyLivenessUpdates && !verify())
+        report_fatal_error("incremental liveness update diverged from a full "
+                           "recompute");
+}
+
+bool ResultLivenessAnalysis::invalidate(
+    Function &F, const PreservedAnalyses &PA,
+    FunctionAnalysisManager::Invalidator &Inv) {
+    auto PAC = PA.getChecker<LivenessAnalysis>();
+    if (PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>() ||
+        (hasPendingUpdates() && PAC.preservedSet<CFGAnalyses>())){
+        flushUpdates();
+        return false;
+    }
+    return true;
+}
+
+bool ResultLivenessAnalysis::verify() const {
+    if (Numbering.size() == 0)
+        return true;
+    const Function &F = *Numbering.getBlock(0)->getParent();
+    ResultLivenessAnalysis Fresh;
+    Fresh.Algorithm = Algorithm;
+    computeLiveness(Fresh, FunctionInfo(F));
+
+    bool OK = true;
+    // The value numbers of the two results may differ after incremental
+    // updates, so the sets are compared by value.
+    for (const BasicBlock &BB : F){
+        LiveValueSet Mine = liveOut(&BB), Theirs = Fresh.liveOut(&BB);
+        bool Same = Mine.size() == Theirs.size();
+        for (const Value *V : Mine)
+            Same = Same && Theirs.contains(V);
+        if (!Same){
+            errs() << "LivenessAnalysis: live-out of " << getValueName(BB)
+                   << " in " << F.getName() << " differs from a full recompute\n";
+            OK = false;
+        }
+    }
+    return OK;
+}
+
+void ResultLivenessAnalysis::walkBlock(
+    unsigned B,
+    function_ref<void(const Instruction &, const DenseBitSet &)> Fn) const {
+    const BasicBlock &BB = *Numbering.getBlock(B);
+    DenseBitSet Live = LiveOut[B];
+    for(auto RIT = BB.rbegin(); RIT != BB.rend(); RIT++){
+        const auto& Inst = *RIT;
+        Fn(Inst, Live);
+        // PHI operands are live-out of the incoming blocks instead.
+        if(isa<PHINode>(Inst)){
+            Live.reset(Values.getIndex(&Inst));
+            continue;
+        }
+        for (const Use &U : Inst.operands()) {
+            unsigned v = Values.getIndex(U.get());
+            if(v != BlockNumbering::InvalidIndex){
+                Live.set(v);
+            }
+        }
+        unsigned Def = Values.getIndex(&Inst);
+        if(Def != BlockNumbering::InvalidIndex){
+            Live.reset(Def);
+        }
+    }
+}
+
+const DenseBitSet *
+ResultLivenessAnalysis::lookupLiveAfter(const Instruction *I) const {
+    unsigned B = Numbering.getIndex(I->getParent());
+    if (B == BlockNumbering::InvalidIndex)
+        return nullptr;
+
+    CachedBlock *Entry = nullptr;
+    for (CachedBlock &C : Cache){
+        if (C.Block == B){
+            Entry = &C;
+            break;
+        }
+    }
+
+    if (!Entry){
+        if (CachedBlocks == 0){
+            Entry = &Uncached;
+        } else if (Cache.size() < CachedBlocks){
+            Cache.emplace_back();
+            Entry = &Cache.back();
+        } else {
+            // Evict the least recently used block.
+            Entry = &*std::min_element(Cache.begin(), Cache.end(),
+                [](const CachedBlock &A, const CachedBlock &B){
+                    return A.LastUse < B.LastUse;
+                });
+        }
+        PhaseTimer Timer(Stats.ExpansionTime);
+        Entry->Block = B;
+        Entry->Slot.clear();
+        Entry->LiveAfter.clear();
+        walkBlock(B, [&](const Instruction &Inst, const DenseBitSet &Live){
+            Entry->Slot[&Inst] = Entry->LiveAfter.size();
+            Entry->LiveAfter.push_back(Live);
+        });
+    }
+    Entry->LastUse = ++UseCounter;
+
+    auto It = Entry->Slot.find(I);
+    return It == Entry->Slot.end() ? nullptr : &Entry->LiveAfter[It->second];
+}
+
+bool ResultLivenessAnalysis::isLiveAfter(const Instruction *I, const Value *V) const {
+    unsigned Idx = Values.getIndex(V);
+    if (Idx == BlockNumbering::InvalidIndex)
+        return false;
+    const DenseBitSet *Live = lookupLiveAfter(I);
+    return Live && Live->test(Idx);
+}
+
+LiveValueSet ResultLivenessAnalysis::liveAfter(const Instruction *I) const {
+    const DenseBitSet *Live = lookupLiveAfter(I);
+    return LiveValueSet(Values, Live ? *Live : DenseBitSet(Values.size()));
+}
+
+bool ResultLivenessAnalysis::isLiveOut(const BasicBlock *BB, const Value *V) const {
+    unsigned B = Numbering.getIndex(BB);
+    unsigned Idx = Values.getIndex(V);
+    return B != BlockNumbering::InvalidIndex && Idx != BlockNumbering::InvalidIndex &&
+           LiveOut[B].test(Idx);
+}
+
+LiveValueSet ResultLivenessAnalysis::liveOut(const BasicBlock *BB) const {
+    unsigned B = Numbering.getIndex(BB);
+    if (B == BlockNumbering::InvalidIndex)
+        return LiveValueSet(Values, DenseBitSet(Values.size()));
+    return LiveValueSet(Values, LiveOut[B]);
+}
+
+bool LiveValueSet::contains(const Value *V) const {
+    unsigned Idx = Values->getIndex(V);
+    return Idx != BlockNumbering::InvalidIndex && Bits.test(Idx);
 }
 
 
@@ -132,16 +849,50 @@ PreservedAnalyses
 LivenessAnalysisPrinter::run(Function &F,
                               FunctionAnalysisManager &FAM) {
 
-    auto Liveness = FAM.getResult<LivenessAnalysis>(F);
+    LivenessOptions Options;
+    Options.Algorithm = Algorithm;
+    // A cached result with pending updates cannot be queried.
+    ResultLivenessAnalysis Computed;
+    const ResultLivenessAnalysis *Liveness = &getCachedResultOr(
+        LivenessAnalysis(Options), F, FAM, Computed,
+        [&](const ResultLivenessAnalysis &R){
+            return R.Algorithm == Algorithm && !R.hasPendingUpdates();
+        });
+
+    ValueNameCache Names(F);
     for (auto &BB : F){
-        OS << "=====Basic block: " << BB.getNameOrAsOperand() << "=====\n";
+        if (Format == OutputFormat::JSONLines){
+            // One line per block; live_after[i] is the live set after its
+            // i-th instruction.
+            json::OStream J(OS);
+            J.object([&]{
+                J.attribute("function", F.getName());
+                J.attribute("block", Names.get(BB));
+                J.attributeArray("live_out", [&]{
+                    for (const auto v : Liveness->liveOut(&BB))
+                        J.value(Names.get(*v));
+                });
+                J.attributeArray("live_after", [&]{
+                    for (auto &I : BB){
+                        J.array([&]{
+                            for (const auto v : Liveness->liveAfter(&I))
+                                J.value(Names.get(*v));
+                        });
+                    }
+                });
+            });
+            OS << "\n";
+            continue;
+        }
+
+        OS << "=====Basic block: " << Names.get(BB) << "=====\n";
         for(auto& I : BB){
-            I.print(errs());
-            errs() << "\n{";
-            for(const auto v : Liveness.ResultInstLiveOut[&I]){
-                errs() << v->getNameOrAsOperand() << " ";
+            Names.printInstruction(OS, I);
+            OS << "\n{";
+            for(const auto v : Liveness->liveAfter(&I)){
+                OS << Names.get(*v) << " ";
             }
-            errs() << "}\n";
+            OS << "}\n";
         }    
     }     
     return PreservedAnalyses::all();
@@ -155,6 +906,39 @@ LivenessAnalysisPrinter::run(Function &F,
 //-----------------------------------------------------------------------------
 AnalysisKey LivenessAnalysis::Key;
 
+// Accepts "print<liveness>", "print<liveness<iterative>>",
+// "print<liveness<ssa>>" and "print<liveness<loops>>".
+static bool parseLivenessPrinterName(StringRef Name, LivenessAlgorithm &Algorithm) {
+  if (!Name.consume_front("print<liveness") || !Name.consume_back(">"))
+    return false;
+  if (Name.empty() || Name == "<iterative>") {
+    Algorithm = LivenessAlgorithm::Iterative;
+    return true;
+  }
+  if (Name == "<ssa>") {
+    Algorithm = LivenessAlgorithm::PathExploration;
+    return true;
+  }
+  if (Name == "<loops>") {
+    Algorithm = LivenessAlgorithm::LoopForest;
+    return true;
+  }
+  return false;
+}
+
+// Accepts "print<pressure>" and "print<pressure<by-class>>".
+static bool parsePressurePrinterName(StringRef Name, PressureOptions &Options) {
+  if (!Name.consume_front("print<pressure") || !Name.consume_back(">"))
+    return false;
+  if (Name.empty())
+    return true;
+  if (Name == "<by-class>") {
+    Options.SplitByClass = true;
+    return true;
+  }
+  return false;
+}
+
 llvm::PassPluginLibraryInfo getLivenessAnalysisPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "liveness", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
@@ -162,8 +946,19 @@ llvm::PassPluginLibraryInfo getLivenessAnalysisPluginInfo() {
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, FunctionPassManager &FPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "print<liveness>") {
-                    FPM.addPass(LivenessAnalysisPrinter(llvm::errs()));
+                  LivenessAlgorithm Algorithm;
+                  if (parseLivenessPrinterName(Name, Algorithm)) {
+                    FPM.addPass(LivenessAnalysisPrinter(llvm::errs(), Algorithm));
+                    return true;
+                  }
+                  PressureOptions Options;
+                  if (parsePressurePrinterName(Name, Options)) {
+                    FPM.addPass(
+                        RegisterPressureAnalysisPrinter(llvm::errs(), Options));
+                    return true;
+                  }
+                  if (Name == "print<interference>") {
+                    FPM.addPass(InterferenceGraphAnalysisPrinter(llvm::errs()));
                     return true;
                   }
                   return false;
@@ -172,6 +967,14 @@ llvm::PassPluginLibraryInfo getLivenessAnalysisPluginInfo() {
             PB.registerAnalysisRegistrationCallback(
                 [](FunctionAnalysisManager &MAM) {
                   MAM.registerPass([&] { return LivenessAnalysis(); });
+                  MAM.registerPass([&] { return RegisterPressureAnalysis(); });
+                  MAM.registerPass([&] { return InterferenceGraphAnalysis(); });
+                  // Shared with the other analyses of this tool; the first
+                  // registration wins. The loop-forest algorithm reuses
+                  // the tree of a cached IDom-mode DominatorsAnalysis
+                  // result, which this plugin links against.
+                  MAM.registerPass([&] { return FunctionInfoAnalysis(); });
+                  MAM.registerPass([&] { return DominatorsAnalysis(); });
                 });
           }};    
           
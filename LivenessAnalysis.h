@@ -13,7 +13,15 @@
 #ifndef LLVM_LIVENESSANALYSIS_H
 #define LLVM_LIVENESSANALYSIS_H
 
+#include "BitSet.h"
+#include "BlockNumbering.h"
+#include "DataflowSolver.h"
+#include "FunctionInfo.h"
+#include "ValueNames.h"
+#include "ValueNumbering.h"
+
 #include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/AbstractCallSite.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
@@ -21,20 +29,188 @@
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <vector>
+
 //------------------------------------------------------------------------------
 // New PM interface
 //------------------------------------------------------------------------------
 namespace llvm
 {
 
+  class AnalysisCache;
+  struct ResultDominators;
+
   using ValueSet = llvm::SmallPtrSet<const llvm::Value *, 8>;
   using BBLiveOutSet = llvm::MapVector<const llvm::BasicBlock *, ValueSet>;
   using InstLiveOutSet = llvm::MapVector<const llvm::Instruction *, ValueSet>;
 
+  // A set of live values at a program point. It owns its bits and refers
+  // to the value numbering of the result it was obtained from.
+  class LiveValueSet
+  {
+  public:
+    class iterator
+    {
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = const Value *;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const Value *const *;
+      using reference = const Value *;
+
+      iterator(const ValueNumbering &Values, DenseBitSet::const_iterator It)
+          : Values(&Values), It(It) {}
+
+      const Value *operator*() const { return Values->getValue(*It); }
+      iterator &operator++()
+      {
+        ++It;
+        return *this;
+      }
+      bool operator==(const iterator &RHS) const { return It == RHS.It; }
+      bool operator!=(const iterator &RHS) const { return It != RHS.It; }
+
+    private:
+      const ValueNumbering *Values;
+      DenseBitSet::const_iterator It;
+    };
+
+    LiveValueSet(const ValueNumbering &Values, DenseBitSet Bits)
+        : Values(&Values), Bits(std::move(Bits)) {}
+
+    bool contains(const Value *V) const;
+    unsigned size() const { return Bits.count(); }
+    bool empty() const { return !Bits.any(); }
+    const DenseBitSet &bits() const { return Bits; }
+
+    // Values are enumerated in value-number order.
+    iterator begin() const { return iterator(*Values, Bits.begin()); }
+    iterator end() const { return iterator(*Values, Bits.end()); }
+
+  private:
+    const ValueNumbering *Values;
+    DenseBitSet Bits;
+  };
+
+  // Selects how the block live-out sets are computed:
+  //  * Iterative       - backward dataflow solved to a fixed point.
+  //  * PathExploration - SSA-based; walks the uses of each value back to
+  //                      its definition. Usually faster when most values
+  //                      are short-lived.
+  //  * LoopForest      - SSA-based; two passes over the blocks, the second
+  //                      one along the loop-nesting forest, whatever the
+  //                      loop depth. Needs the dominator tree to find the
+  //                      back edges and falls back to Iterative on
+  //                      irreducible CFGs.
+  // All treat a PHI operand as live-out of the incoming block.
+  enum class LivenessAlgorithm
+  {
+    Iterative,
+    PathExploration,
+    LoopForest
+  };
+
+  struct LivenessOptions
+  {
+    LivenessAlgorithm Algorithm = LivenessAlgorithm::Iterative;
+    // Also fill ResultBBLiveOut and ResultInstLiveOut with Value-set copies
+    // of the live set of every block and instruction. This costs
+    // O(instructions x live values) memory; the query API below does not
+    // need it.
+    bool MaterializeInstLiveOut = false;
+    // Number of blocks whose per-instruction live sets are kept by the
+    // lazy query API. Zero disables the cache.
+    unsigned CachedBlocks = 4;
+    // On-disk cache the live-out sets are looked up in and added to.
+    // Cached results carry no convergence counters or timings.
+    AnalysisCache *ResultCache = nullptr;
+  };
+
   struct ResultLivenessAnalysis
   {
+    LivenessAlgorithm Algorithm = LivenessAlgorithm::Iterative;
+    // Only populated when LivenessOptions::MaterializeInstLiveOut is set.
     BBLiveOutSet ResultBBLiveOut;
     InstLiveOutSet ResultInstLiveOut;
+
+    BlockNumbering Numbering;
+    ValueNumbering Values;
+    // LiveOut[B] is the live-out set of block B over value numbers.
+    std::vector<DenseBitSet> LiveOut;
+    // Convergence and phase timings of the computation that produced this
+    // result. Lazy queries keep adding to ExpansionTime.
+    mutable DataflowStats Stats;
+
+    // Lazy per-program-point queries. The live set after an instruction is
+    // rebuilt on demand by a backward walk from the live-out of its block;
+    // the last few walked blocks are cached. The cache makes these queries
+    // unsafe to call concurrently on the same result.
+    bool isLiveAfter(const Instruction *I, const Value *V) const;
+    LiveValueSet liveAfter(const Instruction *I) const;
+    bool isLiveOut(const BasicBlock *BB, const Value *V) const;
+    LiveValueSet liveOut(const BasicBlock *BB) const;
+
+    // Walks block B backwards from its live-out set and calls Fn with each
+    // instruction and the set of values live right after it.
+    void walkBlock(unsigned B,
+                   function_ref<void(const Instruction &, const DenseBitSet &)> Fn) const;
+
+    // Incremental maintenance for local edits that keep the CFG and the
+    // block list intact. Notifications are queued and applied together by
+    // flushUpdates(), which must run before the next query; only the
+    // liveness of the values involved in the edits is recomputed, by
+    // walking back from their uses. Edits of terminators or of blocks not
+    // known to the result make flushUpdates() recompute everything.
+    //   * notifyInstructionInserted - after I was inserted.
+    //   * notifyInstructionErased   - before I is erased; I must be unused.
+    //   * notifyUseChanged          - after an operand of User, previously
+    //                                 OldValue, was changed.
+    void notifyInstructionInserted(const Instruction *I);
+    void notifyInstructionErased(const Instruction *I);
+    void notifyUseChanged(const Instruction *User, const Value *OldValue);
+    void flushUpdates();
+    bool hasPendingUpdates() const {
+      return NeedsRecompute || !DirtyValues.empty() || !RetiredValues.empty();
+    }
+
+    // Keeps the result when LivenessAnalysis is preserved, or when the CFG
+    // is preserved and the edits were reported through the notifications
+    // above. Pending updates are flushed in both cases.
+    bool invalidate(Function &F, const PreservedAnalyses &PA,
+                    FunctionAnalysisManager::Invalidator &Inv);
+
+    // Compares the live-out sets against a from-scratch computation and
+    // returns true if they agree. Applied after every flush with
+    // -verify-liveness-updates.
+    bool verify() const;
+
+    unsigned CachedBlocks = 4;
+    bool MaterializeInstLiveOut = false;
+
+  private:
+    void markDirtyOperands(const Instruction *I);
+
+    struct CachedBlock
+    {
+      unsigned Block;
+      uint64_t LastUse;
+      DenseMap<const Instruction *, unsigned> Slot;
+      std::vector<DenseBitSet> LiveAfter;
+    };
+    const DenseBitSet *lookupLiveAfter(const Instruction *I) const;
+
+    mutable std::vector<CachedBlock> Cache;
+    // The only entry when the cache is disabled, refilled on every lookup.
+    mutable CachedBlock Uncached;
+    mutable uint64_t UseCounter = 0;
+
+    // Pending incremental updates: values whose liveness must be
+    // recomputed, value numbers of erased instructions, and blocks whose
+    // instructions changed.
+    std::vector<unsigned> DirtyValues;
+    std::vector<unsigned> RetiredValues;
+    std::vector<unsigned> DirtyBlocks;
+    bool NeedsRecompute = false;
   };
 
   class LivenessAnalysis : public AnalysisInfoMixin<LivenessAnalysis>
@@ -42,10 +218,24 @@ namespace llvm
   public:
     using Result = ResultLivenessAnalysis;
 
+    explicit LivenessAnalysis(LivenessOptions Options = LivenessOptions())
+        : Options(Options) {}
+
+    // Uses the FunctionInfo cached by AM, computing it if needed. In
+    // LoopForest mode the dominator tree comes from a cached IDom-mode
+    // result of DominatorsAnalysis, or is computed from the info.
     Result run(Function &F, FunctionAnalysisManager &AM);
     Result runOnFunction(Function &F);
+    Result runOnFunction(Function &F, const FunctionInfo &Info);
 
   private:
+    // GetDominators is only called in LoopForest mode; it may return
+    // nullptr, in which case the dominator tree is computed from the info.
+    Result compute(Function &F, function_ref<const FunctionInfo &()> GetInfo,
+                   function_ref<const ResultDominators *()> GetDominators);
+
+    LivenessOptions Options;
+
     // A special type used by analysis passes to provide an address that
     // identifies that particular analysis pass type.
     static llvm::AnalysisKey Key;
@@ -59,11 +249,17 @@ namespace llvm
       : public llvm::PassInfoMixin<LivenessAnalysisPrinter>
   {
   public:
-    explicit LivenessAnalysisPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+    explicit LivenessAnalysisPrinter(
+        llvm::raw_ostream &OutS,
+        LivenessAlgorithm Algorithm = LivenessAlgorithm::Iterative,
+        OutputFormat Format = OutputFormat::Text)
+        : OS(OutS), Algorithm(Algorithm), Format(Format) {}
     PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM);
 
   private:
     llvm::raw_ostream &OS;
+    LivenessAlgorithm Algorithm;
+    OutputFormat Format;
   };
 
 }; // End namespace llvm
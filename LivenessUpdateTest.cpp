@@ -0,0 +1,406 @@
+//========================================================================
+// FILE:
+//    LivenessUpdateTest.cpp
+//
+// DESCRIPTION:
+//    Tests the incremental updates of ResultLivenessAnalysis. Instructions
+//    of the analysis-bench shapes and of the given modules, such as those
+//    written by llvm-stress, are inserted, erased, replaced with RAUW and
+//    have their operands changed; the result is told through the notify
+//    calls, flushed, and checked against a full recompute with verify()
+//    and with the per-instruction queries. Hand-written edits cover the
+//    growth of the bit sets past a word, the reuse of retired value
+//    numbers, the recompute when a terminator changes, and the flushes of
+//    the pass manager: through invalidate() when only the CFG analyses are
+//    preserved, and before RegisterPressureAnalysis and
+//    InterferenceGraphAnalysis read the live-out sets.
+//
+// USAGE:
+//      <BUILD/DIR>/liveness-update-test [<module> ...]
+//
+// License: MIT
+//========================================================================
+#include "CFGShapes.h"
+#include "DominatorsAnalysis.h"
+#include "InterferenceGraphAnalysis.h"
+#include "LivenessAnalysis.h"
+#include "RegisterPressureAnalysis.h"
+#include "TestSupport.h"
+
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <random>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// Command line options
+//===----------------------------------------------------------------------===//
+static cl::OptionCategory TestCategory{"test options"};
+
+static cl::list<std::string> InputModules{
+    cl::Positional, cl::desc("<modules whose instructions are edited>"),
+    cl::ZeroOrMore, cl::cat{TestCategory}};
+
+static cl::opt<unsigned> Batches{
+    "batches", cl::desc("Number of random edit batches per function and "
+                        "liveness mode."),
+    cl::init(30), cl::cat{TestCategory}};
+
+//===----------------------------------------------------------------------===//
+// Checks
+//===----------------------------------------------------------------------===//
+enum class UpdatePath { Any, Incremental, Fallback };
+
+// Flushes the notified edits and checks the result against a full
+// recompute, at the block and at the instruction level, and the path the
+// flush took.
+static void flushAndVerify(ResultLivenessAnalysis &Res, Function &F,
+                           UpdatePath Expected, const Twine &What) {
+  check(!verifyFunction(F, &errs()), What + ": the edits keep the IR valid");
+  unsigned Incremental = getStatistic("liveness.NumIncrementalUpdates");
+  unsigned Fallback = getStatistic("liveness.NumFallbackUpdates");
+  check(Res.hasPendingUpdates(), What + ": updates pending");
+  Res.flushUpdates();
+  check(!Res.hasPendingUpdates(), What + ": updates flushed");
+  check(Res.verify(), What + ": verify");
+#if LLVM_ENABLE_STATS
+  if (Expected == UpdatePath::Incremental)
+    check(getStatistic("liveness.NumIncrementalUpdates") == Incremental + 1,
+          What + ": expected an incremental update");
+  if (Expected == UpdatePath::Fallback)
+    check(getStatistic("liveness.NumFallbackUpdates") == Fallback + 1,
+          What + ": expected a full recompute");
+#else
+  (void)Incremental;
+  (void)Fallback;
+#endif
+
+  LivenessOptions Options;
+  Options.Algorithm = Res.Algorithm;
+  Options.MaterializeInstLiveOut = Res.MaterializeInstLiveOut;
+  ResultLivenessAnalysis Fresh = LivenessAnalysis(Options).runOnFunction(F);
+  bool Same = true;
+  for (const BasicBlock &BB : F) {
+    for (const Instruction &I : BB) {
+      LiveValueSet Mine = Res.liveAfter(&I), Theirs = Fresh.liveAfter(&I);
+      Same = Same && Mine.size() == Theirs.size() &&
+             all_of(Mine, [&](const Value *V) { return Theirs.contains(V); });
+      if (Res.MaterializeInstLiveOut)
+        Same = Same &&
+               Res.ResultInstLiveOut[&I] == Fresh.ResultInstLiveOut[&I];
+    }
+  }
+  check(Same, What + ": live sets after every instruction");
+}
+
+//===----------------------------------------------------------------------===//
+// IR edits, each reported to the result
+//===----------------------------------------------------------------------===//
+static Instruction *insertAdd(ResultLivenessAnalysis &Res, Instruction *Before,
+                              Value *LHS, Value *RHS) {
+  IRBuilder<> B(Before);
+  auto *I = cast<Instruction>(B.CreateAdd(LHS, RHS));
+  Res.notifyInstructionInserted(I);
+  return I;
+}
+
+static void eraseInst(ResultLivenessAnalysis &Res, Instruction *I) {
+  Res.notifyInstructionErased(I);
+  I->eraseFromParent();
+}
+
+static void setOperand(ResultLivenessAnalysis &Res, Instruction *User,
+                       unsigned Op, Value *V) {
+  Value *Old = User->getOperand(Op);
+  User->setOperand(Op, V);
+  Res.notifyUseChanged(User, Old);
+}
+
+// Replaces all uses of I with V, which must dominate I, and erases I.
+static void replaceAndErase(ResultLivenessAnalysis &Res, Instruction *I,
+                            Value *V) {
+  SmallPtrSet<Instruction *, 8> Users;
+  for (User *U : I->users())
+    Users.insert(cast<Instruction>(U));
+  I->replaceAllUsesWith(V);
+  for (Instruction *User : Users)
+    Res.notifyUseChanged(User, I);
+  eraseInst(Res, I);
+}
+
+//===----------------------------------------------------------------------===//
+// Tests
+//===----------------------------------------------------------------------===//
+static const LivenessAlgorithm Algorithms[] = {
+    LivenessAlgorithm::Iterative, LivenessAlgorithm::PathExploration,
+    LivenessAlgorithm::LoopForest};
+
+static LivenessOptions getOptions(LivenessAlgorithm Algorithm, bool Eager) {
+  LivenessOptions Options;
+  Options.Algorithm = Algorithm;
+  Options.MaterializeInstLiveOut = Eager;
+  return Options;
+}
+
+// Hand-written edits of entry -> b1 -> ... -> b8, whose blocks extend a
+// chain of values returned at the end.
+static void testChainEdits(LivenessAlgorithm Algorithm, bool Eager) {
+  LLVMContext Ctx;
+  Module M("chain", Ctx);
+  Function *F = buildChain(M, 8);
+  std::vector<BasicBlock *> BBs;
+  for (BasicBlock &BB : *F)
+    BBs.push_back(&BB);
+  Value *A = F->getArg(0), *B = F->getArg(1);
+  // The random edits go through the block cache; these go without it.
+  LivenessOptions Options = getOptions(Algorithm, Eager);
+  Options.CachedBlocks = 0;
+  ResultLivenessAnalysis Res = LivenessAnalysis(Options).runOnFunction(*F);
+
+  // A value defined in the entry block and used at the end is live
+  // across every block.
+  Instruction *Long = insertAdd(Res, BBs[0]->getTerminator(), A, B);
+  Instruction *Ret = BBs.back()->getTerminator();
+  Instruction *Sum = insertAdd(Res, Ret, Ret->getOperand(0), Long);
+  setOperand(Res, Ret, 0, Sum);
+  flushAndVerify(Res, *F, UpdatePath::Incremental, "chain: long live range");
+  check(Res.isLiveOut(BBs[4], Long), "chain: live across b4");
+
+  // More values than fit in a word, all live until the end.
+  Value *Last = Long;
+  for (unsigned I = 0; I != 150; I++)
+    Last = insertAdd(Res, BBs[1]->getTerminator(), Last, A);
+  setOperand(Res, Sum, 1, Last);
+  flushAndVerify(Res, *F, UpdatePath::Incremental, "chain: bit set growth");
+  check(Res.isLiveOut(BBs[6], Last) && !Res.isLiveOut(BBs[6], Long),
+        "chain: live ranges after the growth");
+
+  // RAUW the long value with an argument: its number is retired, and the
+  // instructions inserted in the same batch may take its memory.
+  replaceAndErase(Res, cast<Instruction>(Last), A);
+  for (unsigned I = 0; I != 4; I++)
+    insertAdd(Res, BBs[2]->getTerminator(), A, B);
+  flushAndVerify(Res, *F, UpdatePath::Incremental, "chain: RAUW and reuse");
+  check(Res.isLiveOut(BBs[6], A), "chain: the replacement is live");
+
+  // A new terminator recomputes everything, even with the same successor.
+  Instruction *Br = BBs[3]->getTerminator();
+  Res.notifyInstructionErased(Br);
+  Instruction *NewBr = BranchInst::Create(BBs[4], Br);
+  Br->eraseFromParent();
+  Res.notifyInstructionInserted(NewBr);
+  flushAndVerify(Res, *F, UpdatePath::Fallback, "chain: new terminator");
+}
+
+// Random batches of one to three edits on F, which must verify.
+static void testRandomEdits(Function &F, LivenessAlgorithm Algorithm,
+                            bool Eager, std::mt19937 &Rand) {
+  if (F.isDeclaration())
+    return;
+  ResultLivenessAnalysis Res =
+      LivenessAnalysis(getOptions(Algorithm, Eager)).runOnFunction(F);
+  StringRef Name = F.getName();
+  for (unsigned Batch = 0; Batch != Batches; Batch++) {
+    DominatorTree DT(F);
+    std::vector<Value *> Values;
+    std::vector<Instruction *> Insts;
+    for (Argument &Arg : F.args())
+      Values.push_back(&Arg);
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        Insts.push_back(&I);
+        if (!I.getType()->isVoidTy())
+          Values.push_back(&I);
+      }
+    }
+    // The values of type Ty available right before At, or for any use of
+    // At when At itself is excluded.
+    auto Available = [&](Type *Ty, Instruction *At) {
+      std::vector<Value *> Result;
+      for (Value *V : Values) {
+        auto *I = dyn_cast<Instruction>(V);
+        if (V->getType() == Ty && V != At && (!I || DT.dominates(I, At)))
+          Result.push_back(V);
+      }
+      return Result;
+    };
+
+    bool Edited = false;
+    for (unsigned K = 0, E = 1 + Rand() % 3; K != E; K++) {
+      Instruction *I = Insts[Rand() % Insts.size()];
+      if (isa<PHINode>(I) || I->isEHPad())
+        continue;
+      switch (Rand() % 4) {
+      case 0: { // An add of available values before I.
+        Value *V = Values[Rand() % Values.size()];
+        if (!V->getType()->isIntOrIntVectorTy())
+          break;
+        std::vector<Value *> Ok = Available(V->getType(), I);
+        if (Ok.empty())
+          break;
+        Instruction *New = insertAdd(Res, I, Ok[Rand() % Ok.size()],
+                                     Ok[Rand() % Ok.size()]);
+        Values.push_back(New);
+        Edited = true;
+        break;
+      }
+      case 1: // I, if unused.
+        if (!I->use_empty() || I->isTerminator())
+          break;
+        erase_value(Values, I);
+        erase_value(Insts, I);
+        eraseInst(Res, I);
+        Edited = true;
+        break;
+      case 2: { // Every use of I, by a value that dominates I.
+        if (I->use_empty())
+          break;
+        std::vector<Value *> Ok = Available(I->getType(), I);
+        if (Ok.empty())
+          break;
+        erase_value(Values, I);
+        erase_value(Insts, I);
+        replaceAndErase(Res, I, Ok[Rand() % Ok.size()]);
+        Edited = true;
+        break;
+      }
+      case 3: { // One operand of I.
+        if (I->getNumOperands() == 0)
+          break;
+        unsigned Op = Rand() % I->getNumOperands();
+        Type *Ty = I->getOperand(Op)->getType();
+        if (!Ty->isIntOrIntVectorTy() || isa<Constant>(I->getOperand(Op)))
+          break;
+        std::vector<Value *> Ok = Available(Ty, I);
+        if (Ok.empty())
+          break;
+        setOperand(Res, I, Op, Ok[Rand() % Ok.size()]);
+        Edited = true;
+        break;
+      }
+      }
+    }
+    if (Edited)
+      flushAndVerify(Res, F, UpdatePath::Any, Name + ": random batch");
+  }
+}
+
+static Instruction *getReturn(Function &F) {
+  for (BasicBlock &BB : F)
+    if (isa<ReturnInst>(BB.getTerminator()))
+      return BB.getTerminator();
+  return nullptr;
+}
+
+// The results kept by the pass manager are flushed when the pass that
+// edited the function preserves the CFG, and before the analyses built on
+// the live-out sets read them.
+static void testPassManagerFlushes(LivenessAlgorithm Algorithm) {
+  LLVMContext Ctx;
+  Module M("loopnest", Ctx);
+  Function *F = buildLoopNest(M, 3);
+  Value *A = F->getArg(0);
+
+  FunctionAnalysisManager FAM;
+  LivenessOptions Options = getOptions(Algorithm, /*Eager=*/false);
+  FAM.registerPass([=] { return LivenessAnalysis(Options); });
+  FAM.registerPass([] { return DominatorsAnalysis(DomAlgorithm::IDom); });
+  FAM.registerPass([] { return RegisterPressureAnalysis(); });
+  FAM.registerPass([] { return InterferenceGraphAnalysis(); });
+  FAM.registerPass([] { return FunctionInfoAnalysis(); });
+  PassBuilder PB;
+  PB.registerFunctionAnalyses(FAM);
+
+  ResultLivenessAnalysis &Res = FAM.getResult<LivenessAnalysis>(*F);
+  Instruction *Ret = getReturn(*F);
+  Instruction *Sum = insertAdd(Res, Ret, Ret->getOperand(0), A);
+  setOperand(Res, Ret, 0, Sum);
+  check(Res.hasPendingUpdates(), "pass manager: updates pending");
+  const ResultRegisterPressure &Pressure =
+      FAM.getResult<RegisterPressureAnalysis>(*F);
+  check(!Res.hasPendingUpdates() && Res.verify(),
+        "pass manager: flushed by the register pressure");
+  bool Same = true;
+  for (const BasicBlock &BB : *F)
+    for (const Instruction &I : BB)
+      Same = Same && Pressure.getLiveAfter(&I) == Res.liveAfter(&I).size();
+  check(Same && Pressure.getInstIndex(Sum) != BlockNumbering::InvalidIndex,
+        "pass manager: pressure counted on the flushed sets");
+
+  Instruction *Other = insertAdd(Res, Sum, A, A);
+  setOperand(Res, Sum, 1, Other);
+  FAM.getResult<InterferenceGraphAnalysis>(*F);
+  check(!Res.hasPendingUpdates() && Res.verify(),
+        "pass manager: flushed by the interference graph");
+
+  // Notified edits and a preserved CFG keep the result.
+  replaceAndErase(Res, Other, A);
+  PreservedAnalyses PA = PreservedAnalyses::none();
+  PA.preserveSet<CFGAnalyses>();
+  FAM.invalidate(*F, PA);
+  check(FAM.getCachedResult<LivenessAnalysis>(*F) == &Res,
+        "pass manager: kept with the CFG preserved");
+  check(!Res.hasPendingUpdates() && Res.verify(),
+        "pass manager: flushed by invalidate");
+
+  // Without notifications, the edits are unknown and the result goes.
+  FAM.invalidate(*F, PA);
+  check(!FAM.getCachedResult<LivenessAnalysis>(*F),
+        "pass manager: dropped without notified edits");
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+int main(int Argc, char **Argv) {
+  cl::HideUnrelatedOptions(TestCategory);
+  cl::ParseCommandLineOptions(Argc, Argv,
+                              "Tests the incremental liveness updates\n");
+  llvm_shutdown_obj SDO;
+  // Statistics are only collected once enabled, and tell which path a
+  // flush took.
+  EnableStatistics(/*DoPrintOnExit=*/false);
+
+  std::mt19937 Rand(7);
+  for (LivenessAlgorithm Algorithm : Algorithms) {
+    testPassManagerFlushes(Algorithm);
+    for (bool Eager : {false, true}) {
+      testChainEdits(Algorithm, Eager);
+
+      std::function<Function *(Module &)> Shapes[] = {
+          [](Module &M) { return buildChain(M, 30); },
+          [](Module &M) { return buildLoopNest(M, 5); },
+          [](Module &M) { return buildIrreducible(M, 6); },
+          [](Module &M) { return buildSwitch(M, 12); },
+          [](Module &M) { return buildManyValues(M, 40); },
+      };
+      for (auto &Build : Shapes) {
+        LLVMContext Ctx;
+        Module M("shape", Ctx);
+        testRandomEdits(*Build(M), Algorithm, Eager, Rand);
+      }
+
+      for (const std::string &Path : InputModules) {
+        LLVMContext Ctx;
+        SMDiagnostic Err;
+        std::unique_ptr<Module> M = parseIRFile(Path, Err, Ctx);
+        if (!M) {
+          Err.print(Argv[0], errs());
+          return 1;
+        }
+        for (Function &F : *M)
+          testRandomEdits(F, Algorithm, Eager, Rand);
+      }
+    }
+  }
+  return reportChecks();
+}
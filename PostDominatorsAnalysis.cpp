@@ -0,0 +1,170 @@
+//=============================================================================
+// FILE:
+//    PostDominatorsAnalysis.cpp
+//
+// DESCRIPTION:
+//    Computes the post-dominators by running the dominator engine of
+//    DominatorsAnalysis on the reversed CFG. Registered by the
+//    DominatorsAnalysis plugin.
+//
+// USAGE:
+//    New PM printer, optionally selecting the algorithm (sets or idom)
+//      opt -load-pass-plugin=libDominatorsAnalysis.dylib `\`
+//        -passes="print<postdom<idom>>" -disable-output <input-llvm-file>
+//
+// License: MIT
+//=============================================================================
+#include "PostDominatorsAnalysis.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "postdom"
+
+STATISTIC(NumFunctions, "Number of functions analyzed");
+STATISTIC(NumSweeps, "Number of sweeps to reach the fixed point");
+STATISTIC(NumBlockVisits, "Number of block visits");
+STATISTIC(NumVirtualEdges, "Number of edges from the virtual exit");
+
+AnalysisKey PostDominatorsAnalysis::Key;
+
+// Builds the reversed CFG of the function with a virtual exit, numbered
+// after the blocks, and solves its dominators. The virtual exit leads to
+// every exit block first. Blocks that still cannot be reached from it do
+// not reach an exit; it then also leads to the first of them in post-order,
+// which is the deepest block of its region, until all are reached.
+static void computePostDominators(ResultDominators &Tree, DataflowStats &Stats,
+                                  const FunctionInfo &Info){
+    const unsigned Invalid = BlockNumbering::InvalidIndex;
+    Tree.Numbering = Info.Numbering;
+    unsigned NumBlocks = Info.Numbering.size();
+    if(NumBlocks == 0){
+      Tree.computeOnGraph(CFGSnapshot(), {});
+      Stats = Tree.Stats;
+      return;
+    }
+
+    TimeRecord BuildTime;
+    Optional<PhaseTimer> Timer;
+    Timer.emplace(BuildTime);
+    unsigned Exit = NumBlocks;
+    std::vector<std::pair<unsigned, unsigned>> Edges;
+    Edges.reserve(Info.CFG.getNumEdges() + 1);
+    for(unsigned B = 0; B != NumBlocks; B++){
+      for(unsigned S : Info.successors(B))
+        Edges.push_back({S, B});
+    }
+
+    // Marks the blocks that reach Root, which the virtual exit now leads
+    // to, walking the CFG backwards.
+    std::vector<bool> Reached(NumBlocks, false);
+    SmallVector<unsigned, 32> Stack;
+    auto AddRoot = [&](unsigned Root){
+      Edges.push_back({Exit, Root});
+      NumVirtualEdges++;
+      Reached[Root] = true;
+      Stack.push_back(Root);
+      while(!Stack.empty()){
+        unsigned B = Stack.pop_back_val();
+        for(unsigned P : Info.predecessors(B)){
+          if(!Reached[P]){
+            Reached[P] = true;
+            Stack.push_back(P);
+          }
+        }
+      }
+    };
+    for(unsigned B = 0; B != NumBlocks; B++){
+      if(Info.successors(B).empty())
+        AddRoot(B);
+    }
+    for(auto It = Info.RPO.rbegin(), E = Info.RPO.rend(); It != E; ++It){
+      if(!Reached[*It])
+        AddRoot(*It);
+    }
+    // Unreachable blocks caught in a cycle of their own.
+    for(unsigned B = 0; B != NumBlocks; B++){
+      if(!Reached[B])
+        AddRoot(B);
+    }
+
+    CFGSnapshot Reversed(NumBlocks + 1, std::move(Edges));
+    std::vector<unsigned> RPO = Reversed.reversePostOrder(Exit);
+    Timer.reset();
+
+    Tree.computeOnGraph(Reversed, RPO);
+
+    // Drop the virtual exit. The DFS intervals of the trees it joined stay
+    // disjoint, so blocks of different trees do not post-dominate each
+    // other.
+    Timer.emplace(Tree.Stats.ExpansionTime);
+    for(unsigned &I : Tree.IDom){
+      if(I == Exit)
+        I = Invalid;
+    }
+    Tree.IDom.pop_back();
+    Tree.DFSIn.pop_back();
+    Tree.DFSOut.pop_back();
+    if(Tree.Algorithm == DomAlgorithm::Sets){
+      Tree.Dom.pop_back();
+      for(DenseBitSet &Set : Tree.Dom)
+        Set.resize(NumBlocks);
+    }
+    Timer.reset();
+
+    Stats = Tree.Stats;
+    Stats.InitTime += BuildTime;
+}
+
+ResultPostDominators PostDominatorsAnalysis::run(Function &F,
+                                                 FunctionAnalysisManager &MAM){
+    return runOnFunction(F, MAM.getResult<FunctionInfoAnalysis>(F));
+}
+
+ResultPostDominators PostDominatorsAnalysis::runOnFunction(Function &F){
+    return runOnFunction(F, FunctionInfo(F));
+}
+
+ResultPostDominators PostDominatorsAnalysis::runOnFunction(
+    Function &F, const FunctionInfo &Info){
+    ResultPostDominators res(Algorithm);
+    res.recalculate(Info);
+    NumFunctions++;
+    NumSweeps += res.Stats.Sweeps;
+    NumBlockVisits += res.Stats.BlockVisits;
+    return res;
+}
+
+void ResultPostDominators::recalculate(){
+    if(Tree.Numbering.size() == 0)
+      return;
+    recalculate(FunctionInfo(*Tree.Numbering.getBlock(0)->getParent()));
+}
+
+void ResultPostDominators::recalculate(const FunctionInfo &Info){
+    computePostDominators(Tree, Stats, Info);
+}
+
+bool ResultPostDominators::invalidate(
+    Function &F, const PreservedAnalyses &PA,
+    FunctionAnalysisManager::Invalidator &Inv) {
+  auto PAC = PA.getChecker<PostDominatorsAnalysis>();
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>() ||
+           PAC.preservedSet<CFGAnalyses>());
+}
+
+// Post-dominator printer implementation
+PreservedAnalyses
+PostDominatorsAnalysisPrinter::run(Function &F, FunctionAnalysisManager &MAM) {
+  ResultPostDominators Computed;
+  const ResultPostDominators &PostDominators = getCachedResultOr(
+      PostDominatorsAnalysis(Algorithm), F, MAM, Computed,
+      [&](const ResultPostDominators &R) {
+        return R.getAlgorithm() == Algorithm;
+      });
+  printDominatorSets(OS, PostDominators.getTree(), Format,
+                     "PostDominatorsAnalysis", "postdominators");
+  return PreservedAnalyses::all();
+}
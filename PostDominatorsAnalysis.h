@@ -0,0 +1,118 @@
+//========================================================================
+// FILE:
+//    PostDominatorsAnalysis.h
+//
+// DESCRIPTION:
+//    Declares the PostDominatorsAnalysis pass and its printer. The
+//    post-dominators are the dominators of the reversed CFG, solved by the
+//    same engine as DominatorsAnalysis from a virtual exit that leads to
+//    every exit block. The virtual exit is dropped from the result, so a
+//    function with several exits has a post-dominator forest.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_POSTDOMINATORSANALYSIS_H
+#define LLVM_POSTDOMINATORSANALYSIS_H
+
+#include "DominatorsAnalysis.h"
+
+namespace llvm {
+
+struct ResultPostDominators {
+public:
+  explicit ResultPostDominators(DomAlgorithm Algorithm = DomAlgorithm::Sets) {
+    Tree.Algorithm = Algorithm;
+  }
+
+  // Convergence and phase timings, including building the reversed CFG.
+  DataflowStats Stats;
+
+  // Kept when PostDominatorsAnalysis or the CFG is preserved.
+  bool invalidate(Function &F, const PreservedAnalyses &PA,
+                  FunctionAnalysisManager::Invalidator &Inv);
+
+  // Recomputes the whole result from the reversed CFG of the current
+  // function, optionally from its facts when they are at hand.
+  void recalculate();
+  void recalculate(const FunctionInfo &Info);
+
+  DomAlgorithm getAlgorithm() const { return Tree.Algorithm; }
+  // The forest as a read-only dominators result over the reversed CFG.
+  // Its update and recalculate members would compute forward dominators,
+  // so they are only reachable through the members above.
+  const ResultDominators &getTree() const { return Tree; }
+
+  ArrayRef<const BasicBlock *> blocks() const { return Tree.blocks(); }
+  // The blocks that post-dominate BB, BB included. Returns an empty set
+  // for blocks that are not part of the function.
+  DominatorSetView getBBPostDominators(const BasicBlock *BB) const {
+    return Tree.getBBDominators(BB);
+  }
+  // Returns nullptr for the roots of the forest.
+  const BasicBlock *getIPostDom(const BasicBlock *BB) const {
+    return Tree.getIDom(BB);
+  }
+  // O(1) query; every block post-dominates itself.
+  bool postDominates(const BasicBlock *A, const BasicBlock *B) const {
+    return Tree.dominates(A, B);
+  }
+  bool postDominates(unsigned A, unsigned B) const {
+    return Tree.dominates(A, B);
+  }
+  // Returns nullptr for blocks in different trees of the forest.
+  const BasicBlock *findNearestCommonPostDominator(const BasicBlock *A,
+                                                   const BasicBlock *B) const {
+    return Tree.findNearestCommonDominator(A, B);
+  }
+
+private:
+  // Dominators of the reversed CFG without the virtual exit: Tree.IDom[B]
+  // is the immediate post-dominator of block B, or InvalidIndex for the
+  // roots of the forest. The roots are the exit blocks plus, for every
+  // region that cannot reach an exit (an infinite loop), the first of its
+  // blocks in post-order. Every block is part of the forest, including the
+  // unreachable ones, and the DFS numbers of all trees are disjoint.
+  ResultDominators Tree;
+};
+
+class PostDominatorsAnalysis
+    : public AnalysisInfoMixin<PostDominatorsAnalysis> {
+public:
+  using Result = ResultPostDominators;
+
+  explicit PostDominatorsAnalysis(DomAlgorithm Algorithm = DomAlgorithm::Sets)
+      : Algorithm(Algorithm) {}
+
+  // Uses the FunctionInfo cached by AM, computing it if needed.
+  Result run(Function &F, FunctionAnalysisManager &AM);
+  Result runOnFunction(Function &F);
+  Result runOnFunction(Function &F, const FunctionInfo &Info);
+
+private:
+  DomAlgorithm Algorithm;
+
+  static AnalysisKey Key;
+  friend struct AnalysisInfoMixin<PostDominatorsAnalysis>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class PostDominatorsAnalysisPrinter
+    : public PassInfoMixin<PostDominatorsAnalysisPrinter> {
+public:
+  explicit PostDominatorsAnalysisPrinter(
+      raw_ostream &OutS, DomAlgorithm Algorithm = DomAlgorithm::Sets,
+      OutputFormat Format = OutputFormat::Text)
+      : OS(OutS), Algorithm(Algorithm), Format(Format) {}
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &MAM);
+
+private:
+  raw_ostream &OS;
+  DomAlgorithm Algorithm;
+  OutputFormat Format;
+};
+
+} // End namespace llvm
+
+#endif // LLVM_POSTDOMINATORSANALYSIS_H
@@ -0,0 +1,372 @@
+//=============================================================================
+// FILE:
+//    RegisterPressureAnalysis.cpp
+//
+// DESCRIPTION:
+//    Counts the values live after every instruction from the live-out sets
+//    of LivenessAnalysis. Registered by the LivenessAnalysis plugin.
+//
+// USAGE:
+//    New PM printer, optionally splitting the counts by register class
+//      opt -load-pass-plugin=libLivenessAnalysis.dylib `\`
+//        -passes="print<pressure<by-class>>" -disable-output <input-llvm-file>
+//
+// License: MIT
+//=============================================================================
+#include "RegisterPressureAnalysis.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/Support/JSON.h"
+
+#include <algorithm>
+#include <queue>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "pressure"
+
+STATISTIC(NumFunctions, "Number of functions analyzed");
+STATISTIC(NumInstructions, "Number of program points counted");
+
+AnalysisKey RegisterPressureAnalysis::Key;
+
+PressureClass llvm::getPressureClass(Type *Ty, const DataLayout &DL){
+    if(Ty->isIntegerTy() || Ty->isPointerTy())
+      return PressureClass::Integer;
+    if(Ty->isFloatingPointTy())
+      return PressureClass::Float;
+    if(Ty->isX86_MMXTy())
+      return PressureClass::Vector64;
+    if(!isa<FixedVectorType>(Ty))
+      return PressureClass::Other;
+    uint64_t Bits = DL.getTypeSizeInBits(Ty).getFixedSize();
+    if(Bits <= 64)
+      return PressureClass::Vector64;
+    if(Bits <= 128)
+      return PressureClass::Vector128;
+    if(Bits <= 256)
+      return PressureClass::Vector256;
+    if(Bits <= 512)
+      return PressureClass::Vector512;
+    return PressureClass::VectorWide;
+}
+
+StringRef llvm::getPressureClassName(PressureClass C){
+    switch(C){
+    case PressureClass::Integer:
+        return "int";
+    case PressureClass::Float:
+        return "float";
+    case PressureClass::Vector64:
+        return "v64";
+    case PressureClass::Vector128:
+        return "v128";
+    case PressureClass::Vector256:
+        return "v256";
+    case PressureClass::Vector512:
+        return "v512";
+    case PressureClass::VectorWide:
+        return "vwide";
+    case PressureClass::Other:
+        return "other";
+    }
+    llvm_unreachable("unknown pressure class");
+}
+
+// Walks every block backwards from its live-out set, as walkBlock does,
+// but keeps only the size of the live set: a value is counted when its
+// first use is met and uncounted at its definition. One set is reused for
+// all blocks.
+static void computePressure(ResultRegisterPressure &res, const Function &F,
+                            const ResultLivenessAnalysis &Liveness){
+    const unsigned Invalid = BlockNumbering::InvalidIndex;
+    const BlockNumbering &Numbering = Liveness.Numbering;
+    const ValueNumbering &Values = Liveness.Values;
+    const bool Split = res.Options.SplitByClass;
+    unsigned NumBlocks = Numbering.size();
+    res.Numbering = Numbering;
+    res.Stats = DataflowStats();
+
+    Optional<PhaseTimer> Timer;
+    Timer.emplace(res.Stats.InitTime);
+    res.BlockBegin.assign(1, 0);
+    res.BlockBegin.reserve(NumBlocks + 1);
+    for(unsigned B = 0; B != NumBlocks; B++){
+      for(const Instruction &I : *Numbering.getBlock(B))
+        res.Insts.push_back(&I);
+      res.BlockBegin.push_back(res.Insts.size());
+    }
+    unsigned NumInsts = res.Insts.size();
+    res.InstIndex.reserve(NumInsts);
+    for(unsigned I = 0; I != NumInsts; I++)
+      res.InstIndex[res.Insts[I]] = I;
+
+    // The class of every value number, looked up as bits flip.
+    std::vector<unsigned char> ValueClass;
+    if(Split){
+      const DataLayout &DL = F.getParent()->getDataLayout();
+      ValueClass.resize(Values.size(), unsigned(PressureClass::Other));
+      for(unsigned V = 0; V != Values.size(); V++){
+        // Numbers of erased values are kept, but never live.
+        if(const Value *Val = Values.getValue(V))
+          ValueClass[V] = unsigned(getPressureClass(Val->getType(), DL));
+      }
+      res.ClassLiveAfter.assign(size_t(NumInsts) * NumPressureClasses, 0);
+      res.BlockClassMax.assign(size_t(NumBlocks) * NumPressureClasses, 0);
+    }
+    res.LiveAfter.assign(NumInsts, 0);
+    res.BlockMax.assign(NumBlocks, 0);
+    Timer.reset();
+
+    Timer.emplace(res.Stats.ExpansionTime);
+    DenseBitSet Live(Values.size());
+    unsigned Count = 0;
+    unsigned ClassCount[NumPressureClasses];
+    auto Add = [&](unsigned V){
+      if(Live.test(V))
+        return;
+      Live.set(V);
+      Count++;
+      if(Split)
+        ClassCount[ValueClass[V]]++;
+    };
+    auto Remove = [&](unsigned V){
+      if(!Live.test(V))
+        return;
+      Live.reset(V);
+      Count--;
+      if(Split)
+        ClassCount[ValueClass[V]]--;
+    };
+
+    for(unsigned B = 0; B != NumBlocks; B++){
+      Live = Liveness.LiveOut[B];
+      Count = Live.count();
+      if(Split){
+        std::fill(ClassCount, ClassCount + NumPressureClasses, 0);
+        for(unsigned V : Live)
+          ClassCount[ValueClass[V]]++;
+      }
+
+      unsigned Max = 0;
+      unsigned *ClassMax =
+          Split ? &res.BlockClassMax[size_t(B) * NumPressureClasses] : nullptr;
+      for(unsigned I = res.BlockBegin[B + 1]; I-- != res.BlockBegin[B];){
+        const Instruction &Inst = *res.Insts[I];
+        res.LiveAfter[I] = Count;
+        Max = std::max(Max, Count);
+        if(Split){
+          unsigned *Counts = &res.ClassLiveAfter[size_t(I) * NumPressureClasses];
+          for(unsigned C = 0; C != NumPressureClasses; C++){
+            Counts[C] = ClassCount[C];
+            ClassMax[C] = std::max(ClassMax[C], ClassCount[C]);
+          }
+        }
+
+        // PHI operands are live-out of the incoming blocks instead.
+        if(!isa<PHINode>(Inst)){
+          for(const Use &U : Inst.operands()){
+            unsigned V = Values.getIndex(U.get());
+            if(V != Invalid)
+              Add(V);
+          }
+        }
+        unsigned Def = Values.getIndex(&Inst);
+        if(Def != Invalid)
+          Remove(Def);
+      }
+      res.BlockMax[B] = Max;
+      res.MaxLive = std::max(res.MaxLive, Max);
+    }
+    res.Stats.Sweeps = 1;
+    res.Stats.BlockVisits = NumBlocks;
+
+    // Keeps the best TopK points seen so far in a heap whose top is the
+    // worst of them. Points are seen in layout order, so a later point with
+    // the same count never replaces an earlier one.
+    auto Worse = [&](unsigned A, unsigned B){
+      if(res.LiveAfter[A] != res.LiveAfter[B])
+        return res.LiveAfter[A] < res.LiveAfter[B];
+      return A > B;
+    };
+    auto Better = [&](unsigned A, unsigned B){ return Worse(B, A); };
+    std::priority_queue<unsigned, std::vector<unsigned>, decltype(Better)>
+        Heap(Better);
+    unsigned TopK = std::min(res.Options.TopK, NumInsts);
+    for(unsigned I = 0; I != NumInsts && TopK != 0; I++){
+      if(Heap.size() < TopK){
+        Heap.push(I);
+      } else if(Worse(Heap.top(), I)){
+        Heap.pop();
+        Heap.push(I);
+      }
+    }
+    res.HotPoints.resize(Heap.size());
+    for(unsigned Slot = Heap.size(); Slot-- != 0;){
+      unsigned I = Heap.top();
+      Heap.pop();
+      res.HotPoints[Slot] = {res.Insts[I], res.LiveAfter[I]};
+    }
+    Timer.reset();
+}
+
+ResultRegisterPressure RegisterPressureAnalysis::run(Function &F,
+                                                     FunctionAnalysisManager &AM){
+    ResultLivenessAnalysis &Liveness = AM.getResult<LivenessAnalysis>(F);
+    if(Liveness.hasPendingUpdates())
+      Liveness.flushUpdates();
+    return runOnFunction(F, Liveness);
+}
+
+ResultRegisterPressure RegisterPressureAnalysis::runOnFunction(
+    const Function &F, const ResultLivenessAnalysis &Liveness){
+    ResultRegisterPressure res;
+    res.Options = Options;
+    computePressure(res, F, Liveness);
+    NumFunctions++;
+    NumInstructions += res.Insts.size();
+    return res;
+}
+
+bool ResultRegisterPressure::invalidate(
+    Function &F, const PreservedAnalyses &PA,
+    FunctionAnalysisManager::Invalidator &Inv) {
+  auto PAC = PA.getChecker<RegisterPressureAnalysis>();
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>());
+}
+
+unsigned ResultRegisterPressure::getInstIndex(const Instruction *I) const {
+  auto It = InstIndex.find(I);
+  return It == InstIndex.end() ? BlockNumbering::InvalidIndex : It->second;
+}
+
+unsigned ResultRegisterPressure::getLiveAfter(const Instruction *I) const {
+  unsigned Idx = getInstIndex(I);
+  return Idx == BlockNumbering::InvalidIndex ? 0 : LiveAfter[Idx];
+}
+
+unsigned ResultRegisterPressure::getLiveAfter(const Instruction *I,
+                                              PressureClass C) const {
+  assert(Options.SplitByClass && "counts were not split by class");
+  unsigned Idx = getInstIndex(I);
+  if (Idx == BlockNumbering::InvalidIndex)
+    return 0;
+  return ClassLiveAfter[size_t(Idx) * NumPressureClasses + unsigned(C)];
+}
+
+unsigned ResultRegisterPressure::getBlockMax(const BasicBlock *BB) const {
+  unsigned B = Numbering.getIndex(BB);
+  return B == BlockNumbering::InvalidIndex ? 0 : BlockMax[B];
+}
+
+unsigned ResultRegisterPressure::getBlockMax(const BasicBlock *BB,
+                                             PressureClass C) const {
+  assert(Options.SplitByClass && "counts were not split by class");
+  unsigned B = Numbering.getIndex(BB);
+  if (B == BlockNumbering::InvalidIndex)
+    return 0;
+  return BlockClassMax[size_t(B) * NumPressureClasses + unsigned(C)];
+}
+
+// Register pressure printer implementation
+PreservedAnalyses
+RegisterPressureAnalysisPrinter::run(Function &F,
+                                     FunctionAnalysisManager &FAM) {
+  ResultRegisterPressure Computed;
+  const ResultRegisterPressure *Pressure = &getCachedResultOr(
+      RegisterPressureAnalysis(Options), F, FAM, Computed,
+      [&](const ResultRegisterPressure &R) {
+        return R.Options.SplitByClass == Options.SplitByClass &&
+               R.Options.TopK == Options.TopK;
+      });
+  const BlockNumbering &Numbering = Pressure->Numbering;
+  const bool Split = Pressure->Options.SplitByClass;
+
+  ValueNameCache Names(F);
+  auto InstText = [&](const Instruction &I) {
+    std::string Text;
+    raw_string_ostream TS(Text);
+    Names.printInstruction(TS, I);
+    return StringRef(TS.str()).ltrim().str();
+  };
+
+  for (unsigned B = 0; B != Numbering.size(); B++) {
+    const BasicBlock &BB = *Numbering.getBlock(B);
+    ArrayRef<unsigned> Counts = Pressure->getBlockLiveAfter(B);
+    if (Format == OutputFormat::JSONLines) {
+      // live_after[i] is the count after the i-th instruction of the block;
+      // the classes no value of the block belongs to are left out.
+      json::OStream J(OS);
+      J.object([&] {
+        J.attribute("function", F.getName());
+        J.attribute("block", Names.get(BB));
+        J.attributeArray("live_after", [&] {
+          for (unsigned N : Counts)
+            J.value(N);
+        });
+        J.attribute("max", Pressure->BlockMax[B]);
+        if (!Split)
+          return;
+        J.attributeObject("live_after_by_class", [&] {
+          for (unsigned C = 0; C != NumPressureClasses; C++) {
+            if (Pressure->BlockClassMax[B * NumPressureClasses + C] == 0)
+              continue;
+            J.attributeArray(getPressureClassName(PressureClass(C)), [&] {
+              for (unsigned I = Pressure->BlockBegin[B];
+                   I != Pressure->BlockBegin[B + 1]; I++)
+                J.value(Pressure->ClassLiveAfter[I * NumPressureClasses + C]);
+            });
+          }
+        });
+        J.attributeObject("max_by_class", [&] {
+          for (unsigned C = 0; C != NumPressureClasses; C++) {
+            unsigned Max = Pressure->BlockClassMax[B * NumPressureClasses + C];
+            if (Max != 0)
+              J.attribute(getPressureClassName(PressureClass(C)), Max);
+          }
+        });
+      });
+      OS << "\n";
+      continue;
+    }
+
+    OS << "(RegisterPressureAnalysis) Basic Block " << Names.get(BB) << "{ ";
+    for (unsigned N : Counts)
+      OS << N << " ";
+    OS << "} max " << Pressure->BlockMax[B];
+    if (Split) {
+      for (unsigned C = 0; C != NumPressureClasses; C++) {
+        unsigned Max = Pressure->BlockClassMax[B * NumPressureClasses + C];
+        if (Max != 0)
+          OS << " " << getPressureClassName(PressureClass(C)) << " " << Max;
+      }
+    }
+    OS << "\n";
+  }
+
+  if (Format == OutputFormat::JSONLines) {
+    json::OStream J(OS);
+    J.object([&] {
+      J.attribute("function", F.getName());
+      J.attribute("max", Pressure->MaxLive);
+      J.attributeArray("hot_points", [&] {
+        for (const PressurePoint &P : Pressure->HotPoints) {
+          J.object([&] {
+            J.attribute("block", Names.get(*P.Inst->getParent()));
+            J.attribute("instruction", InstText(*P.Inst));
+            J.attribute("live", P.Live);
+          });
+        }
+      });
+    });
+    OS << "\n";
+    return PreservedAnalyses::all();
+  }
+
+  for (const PressurePoint &P : Pressure->HotPoints)
+    OS << "(RegisterPressureAnalysis) Hot point " << P.Live << " in "
+       << Names.get(*P.Inst->getParent()) << " after " << InstText(*P.Inst)
+       << "\n";
+  return PreservedAnalyses::all();
+}
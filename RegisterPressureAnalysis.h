@@ -0,0 +1,145 @@
+//========================================================================
+// FILE:
+//    RegisterPressureAnalysis.h
+//
+// DESCRIPTION:
+//    Declares the RegisterPressureAnalysis pass and its printer. The
+//    pressure at a program point is the number of values live right after
+//    an instruction, as ResultLivenessAnalysis::liveAfter reports them,
+//    optionally split by the register class of their type. It is counted
+//    in one backward walk over each block from its live-out set, updating
+//    the counts as values become live or die, so the per-instruction live
+//    sets are never built.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_REGISTERPRESSUREANALYSIS_H
+#define LLVM_REGISTERPRESSUREANALYSIS_H
+
+#include "LivenessAnalysis.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/DataLayout.h"
+
+#include <vector>
+
+namespace llvm {
+
+// Register classes of the values. Pointers count as integers. Fixed
+// vectors are classed by their size rounded up to the next class; scalable
+// vectors, aggregates and other first-class types fall under Other.
+enum class PressureClass {
+  Integer,
+  Float,
+  Vector64,
+  Vector128,
+  Vector256,
+  Vector512,
+  VectorWide,
+  Other
+};
+enum : unsigned { NumPressureClasses = unsigned(PressureClass::Other) + 1 };
+
+PressureClass getPressureClass(Type *Ty, const DataLayout &DL);
+// Short name used by the printers: int, float, v64 ... v512, vwide, other.
+StringRef getPressureClassName(PressureClass C);
+
+struct PressureOptions {
+  // Also count the live values of every class.
+  bool SplitByClass = false;
+  // Number of hot points kept per function.
+  unsigned TopK = 5;
+};
+
+// A program point and the number of values live there.
+struct PressurePoint {
+  const Instruction *Inst;
+  unsigned Live;
+};
+
+struct ResultRegisterPressure {
+  BlockNumbering Numbering;
+  PressureOptions Options;
+  // Instructions in layout order. Those of block B are Insts[BlockBegin[B]]
+  // up to Insts[BlockBegin[B + 1]] excluded.
+  std::vector<const Instruction *> Insts;
+  std::vector<unsigned> BlockBegin;
+  DenseMap<const Instruction *, unsigned> InstIndex;
+  // LiveAfter[I] is the number of values live right after Insts[I], and
+  // BlockMax[B] the largest of them in block B.
+  std::vector<unsigned> LiveAfter;
+  std::vector<unsigned> BlockMax;
+  // Only with Options.SplitByClass, NumPressureClasses entries per instruction and
+  // per block: the count of each class, and its own maximum in the block.
+  std::vector<unsigned> ClassLiveAfter;
+  std::vector<unsigned> BlockClassMax;
+  unsigned MaxLive = 0;
+  // The Options.TopK points with the most live values, most first;
+  // ties are broken in layout order.
+  std::vector<PressurePoint> HotPoints;
+  // Timing of the walk, as the expansion phase.
+  DataflowStats Stats;
+
+  // Only kept when RegisterPressureAnalysis or all analyses are preserved:
+  // the counts do not follow the incremental updates of the liveness.
+  bool invalidate(Function &F, const PreservedAnalyses &PA,
+                  FunctionAnalysisManager::Invalidator &Inv);
+
+  // Return 0 for instructions and blocks that are not part of the function.
+  unsigned getLiveAfter(const Instruction *I) const;
+  unsigned getBlockMax(const BasicBlock *BB) const;
+  // Only valid with Options.SplitByClass.
+  unsigned getLiveAfter(const Instruction *I, PressureClass C) const;
+  unsigned getBlockMax(const BasicBlock *BB, PressureClass C) const;
+
+  // The counts after each instruction of block B, in order.
+  ArrayRef<unsigned> getBlockLiveAfter(unsigned B) const {
+    return makeArrayRef(LiveAfter).slice(BlockBegin[B],
+                                         BlockBegin[B + 1] - BlockBegin[B]);
+  }
+  // Position of I in Insts, or InvalidIndex.
+  unsigned getInstIndex(const Instruction *I) const;
+};
+
+class RegisterPressureAnalysis
+    : public AnalysisInfoMixin<RegisterPressureAnalysis> {
+public:
+  using Result = ResultRegisterPressure;
+
+  explicit RegisterPressureAnalysis(PressureOptions Options = PressureOptions())
+      : Options(Options) {}
+
+  // Uses the LivenessAnalysis result cached by AM, computing it if needed.
+  Result run(Function &F, FunctionAnalysisManager &AM);
+  // Counts from the live-out sets of Liveness, computed for F.
+  Result runOnFunction(const Function &F,
+                       const ResultLivenessAnalysis &Liveness);
+
+private:
+  PressureOptions Options;
+
+  static AnalysisKey Key;
+  friend struct AnalysisInfoMixin<RegisterPressureAnalysis>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class RegisterPressureAnalysisPrinter
+    : public PassInfoMixin<RegisterPressureAnalysisPrinter> {
+public:
+  explicit RegisterPressureAnalysisPrinter(
+      raw_ostream &OutS, PressureOptions Options = PressureOptions(),
+      OutputFormat Format = OutputFormat::Text)
+      : OS(OutS), Options(Options), Format(Format) {}
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM);
+
+private:
+  raw_ostream &OS;
+  PressureOptions Options;
+  OutputFormat Format;
+};
+
+} // End namespace llvm
+
+#endif // LLVM_REGISTERPRESSUREANALYSIS_H
@@ -4,30 +4,82 @@
 //
 // DESCRIPTION:
 //    A command-line tool that do dominators and liveout analysis in the input LLVM file. Internally it uses the
-//    DominatorsAnalysis and LivenessAnalysis passes.
+//    DominatorsAnalysis and LivenessAnalysis passes, and can also print the
+//    post-dominators, dominance frontiers, register pressure and the
+//    interference graph (PostDominatorsAnalysis, DominanceFrontiersAnalysis,
+//    RegisterPressureAnalysis and InterferenceGraphAnalysis).
 //
 // USAGE:
 //    # First, generate an LLVM file:
 //      clang -emit-llvm <input-file> -o <output-llvm-file>
 //    # Now you can run this tool as follows:
 //      <BUILD/DIR>/bin/static <output-llvm-file>
+//    # Functions can be analyzed concurrently; the output does not change:
+//      <BUILD/DIR>/bin/static -j 8 <output-llvm-file>
+//    # Threads are balanced by a cost estimated from the blocks, edges and
+//    # instructions of each function, with weights that can be tuned to
+//    # the function_time of the -json-summary records:
+//      <BUILD/DIR>/bin/static -j 8 -cost-per-block=2 -cost-per-edge=1 `\`
+//        -cost-per-inst=0.5 <output-llvm-file>
+//    # Convergence counters and phase timings, as -stats/-time-passes
+//    # totals or as a per-function JSON summary:
+//      <BUILD/DIR>/bin/static -stats -time-passes <output-llvm-file>
+//      <BUILD/DIR>/bin/static -json-summary=<file> <output-llvm-file>
+//    # Buffered output to a file (or "-" for stdout), optionally as one
+//    # JSON object per basic block and line:
+//      <BUILD/DIR>/bin/static -o <file> -output-format=jsonl <output-llvm-file>
+//    # Reuse the results of unchanged functions across runs:
+//      <BUILD/DIR>/bin/static -cache-dir=<dir> <output-llvm-file>
+//    # Analyze many modules, given as a directory of .bc/.ll files or as a
+//    # file with one path per line; parsing, analysis and output overlap:
+//      <BUILD/DIR>/bin/static -batch=<dir-or-list> -o <file>
+//    # Keep only one function body in memory at a time:
+//      <BUILD/DIR>/bin/static -lazy <output-llvm-file>
+//    # Live value counts per instruction and block, split by register
+//    # class, with the 10 highest points of every function:
+//      <BUILD/DIR>/bin/static -analysis=pressure -pressure-by-class `\`
+//        -pressure-top=10 <output-llvm-file>
 //
 // License: MIT
 //========================================================================
+#include "AnalysisCache.h"
+#include "DominanceFrontiersAnalysis.h"
 #include "DominatorsAnalysis.h"
+#include "InterferenceGraphAnalysis.h"
 #include "LivenessAnalysis.h"
+#include "PostDominatorsAnalysis.h"
+#include "RegisterPressureAnalysis.h"
 
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IRReader/IRReader.h"
+#include "llvm/Pass.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
 using namespace llvm;
 
 enum MyAnalysis{
   DOMINATORS,
-  LIVENESS
+  LIVENESS,
+  POSTDOMINATORS,
+  FRONTIERS,
+  PRESSURE,
+  INTERFERENCE
 };
 
 //===----------------------------------------------------------------------===//
@@ -39,38 +91,209 @@ static cl::opt<std::string> InputModule{cl::Positional,
                                         cl::desc{"<Module to analyze>"},
                                         cl::value_desc{"bitcode filename"},
                                         cl::init(""),
-                                        cl::Required,
+                                        cl::Optional,
                                         cl::cat{AnalysisCategory}};
 
-static cl::opt<MyAnalysis> AnalysisType{
-      "analysis", cl::desc("Choose an analysis."),
-      //cl::init(JITKind::Orc),
-      cl::Required,
+static cl::opt<DomAlgorithm> DomAlgorithmOpt{
+      "dom-algorithm",
+      cl::desc("Algorithm used by the dominators and post-dominators "
+               "analyses."),
+      cl::init(DomAlgorithm::Sets),
+      cl::values(clEnumValN(DomAlgorithm::Sets, "sets",
+                            "Iterative bit-vector dominator sets"),
+                 clEnumValN(DomAlgorithm::IDom, "idom",
+                            "Cooper-Harvey-Kennedy immediate dominators")),
+      cl::cat{AnalysisCategory}};
+
+static cl::list<MyAnalysis> AnalysisTypes{
+      "analysis",
+      cl::desc("Choose one or more analyses, comma separated or repeated. "
+               "Selected together, they share one walk over each function."),
+      cl::OneOrMore, cl::CommaSeparated,
       cl::values(clEnumValN(MyAnalysis::DOMINATORS, "dom", "Dominators"),
-                 clEnumValN(MyAnalysis::LIVENESS, "liveout", "Liveness analysis")),
+                 clEnumValN(MyAnalysis::LIVENESS, "liveout", "Liveness analysis"),
+                 clEnumValN(MyAnalysis::POSTDOMINATORS, "postdom",
+                            "Post-dominators"),
+                 clEnumValN(MyAnalysis::FRONTIERS, "df",
+                            "Dominance frontiers, from the dominators"),
+                 clEnumValN(MyAnalysis::PRESSURE, "pressure",
+                            "Register pressure, from the liveness"),
+                 clEnumValN(MyAnalysis::INTERFERENCE, "interference",
+                            "Interference graph, from the liveness")),
+      cl::cat{AnalysisCategory}};
+
+
+static cl::opt<LivenessAlgorithm> LivenessAlgorithmOpt{
+      "liveness-algorithm", cl::desc("Algorithm used by the liveness analysis."),
+      cl::init(LivenessAlgorithm::Iterative),
+      cl::values(clEnumValN(LivenessAlgorithm::Iterative, "iterative",
+                            "Iterative backward dataflow"),
+                 clEnumValN(LivenessAlgorithm::PathExploration, "ssa",
+                            "SSA path exploration from the uses of each value"),
+                 clEnumValN(LivenessAlgorithm::LoopForest, "loops",
+                            "Two passes along the loop-nesting forest, with "
+                            "back edges taken from the dominators analysis; "
+                            "iterative on irreducible CFGs")),
+      cl::cat{AnalysisCategory}};
+
+static cl::opt<bool> PressureByClass{
+      "pressure-by-class",
+      cl::desc("Split the register pressure by the class of the live values: "
+               "integer, float and vector widths."),
+      cl::init(false), cl::cat{AnalysisCategory}};
+
+static cl::opt<unsigned> PressureTop{
+      "pressure-top",
+      cl::desc("Number of points with the highest register pressure reported "
+               "per function."),
+      cl::value_desc{"K"}, cl::init(5), cl::cat{AnalysisCategory}};
+
+static cl::opt<InterferenceStorage> InterferenceStorageOpt{
+      "interference-storage",
+      cl::desc("Storage of the interference graph."),
+      cl::init(InterferenceStorage::Auto),
+      cl::values(clEnumValN(InterferenceStorage::Auto, "auto",
+                            "Bit matrix for functions with few values, lists "
+                            "otherwise"),
+                 clEnumValN(InterferenceStorage::Matrix, "matrix",
+                            "Triangular bit matrix"),
+                 clEnumValN(InterferenceStorage::Lists, "lists",
+                            "Sorted adjacency lists")),
       cl::cat{AnalysisCategory}};
 
+static cl::opt<unsigned> NumThreads{
+      "j", cl::desc("Number of threads used to analyze functions concurrently."),
+      cl::value_desc{"N"}, cl::init(1), cl::Prefix, cl::cat{AnalysisCategory}};
+
+// The cost of a function, which -j balances across the threads, is
+// estimated as a weighted sum of its sizes. By default that is the number
+// of blocks and instructions; the weights are meant to be tuned to the
+// function_time of the -json-summary records of the modules at hand.
+static cl::opt<double> CostPerBlock{
+      "cost-per-block",
+      cl::desc("Estimated cost of each basic block when scheduling functions."),
+      cl::value_desc{"C"}, cl::init(1.0), cl::cat{AnalysisCategory}};
+
+static cl::opt<double> CostPerEdge{
+      "cost-per-edge",
+      cl::desc("Estimated cost of each CFG edge when scheduling functions."),
+      cl::value_desc{"C"}, cl::init(0.0), cl::cat{AnalysisCategory}};
+
+static cl::opt<double> CostPerInst{
+      "cost-per-inst",
+      cl::desc("Estimated cost of each instruction when scheduling functions."),
+      cl::value_desc{"C"}, cl::init(1.0), cl::cat{AnalysisCategory}};
+
+static cl::opt<bool> EagerLiveness{
+      "eager-liveness",
+      cl::desc("Materialize the live set of every instruction up front "
+               "instead of rebuilding them on demand."),
+      cl::init(false), cl::cat{AnalysisCategory}};
+
+static cl::opt<std::string> OutputFilename{
+      "o",
+      cl::desc("Write the results to <file> ('-' for stdout) through a "
+               "buffered stream instead of stderr."),
+      cl::value_desc{"file"}, cl::init(""), cl::cat{AnalysisCategory}};
+
+static cl::opt<OutputFormat> OutputFormatOpt{
+      "output-format", cl::desc("Format of the results."),
+      cl::init(OutputFormat::Text),
+      cl::values(clEnumValN(OutputFormat::Text, "text", "Human readable listing"),
+                 clEnumValN(OutputFormat::JSONLines, "jsonl",
+                            "One JSON object per basic block and line")),
+      cl::cat{AnalysisCategory}};
+
+static cl::opt<std::string> JSONSummary{
+      "json-summary",
+      cl::desc("Write the convergence counters and phase timings of every "
+               "function as JSON to <file>."),
+      cl::value_desc{"file"}, cl::init(""), cl::cat{AnalysisCategory}};
+
+static cl::opt<std::string> CacheDir{
+      "cache-dir",
+      cl::desc("Load the results of functions analyzed by earlier runs from "
+               "<dir> and store new ones there."),
+      cl::value_desc{"dir"}, cl::init(""), cl::cat{AnalysisCategory}};
+
+static cl::opt<std::string> BatchInput{
+      "batch",
+      cl::desc("Analyze all .bc and .ll files of a directory, or the files "
+               "listed one per line in a file, instead of a single module."),
+      cl::value_desc{"dir-or-list"}, cl::init(""), cl::cat{AnalysisCategory}};
+
+static cl::opt<unsigned> BatchQueueDepth{
+      "batch-queue-depth",
+      cl::desc("Number of parsed modules, and of analyzed modules waiting to "
+               "be written, that -batch keeps in memory."),
+      cl::value_desc{"N"}, cl::init(4), cl::cat{AnalysisCategory}};
+
+static cl::opt<bool> LazyLoading{
+      "lazy",
+      cl::desc("Map the bitcode and read one function body at a time, "
+               "dropping it once it has been analyzed. Functions are then "
+               "analyzed serially."),
+      cl::init(false), cl::cat{AnalysisCategory}};
 
 //===----------------------------------------------------------------------===//
 // static - implementation
 //===----------------------------------------------------------------------===//
-static void doAnalysis(Module &M, MyAnalysis MA) {
-  // Create a function pass manager and add the specified pas to it.
-  FunctionPassManager FPM;
-  if(MA == MyAnalysis::DOMINATORS){
-      DominatorsAnalysisPrinter DAP(llvm::errs());
-      FPM.addPass(DAP);
-  } else {
-      LivenessAnalysisPrinter LAP(llvm::errs());
-      FPM.addPass(LAP);
+// Sizes of a function and the cost estimated from them.
+struct FunctionCost {
+  unsigned Blocks = 0;
+  unsigned Edges = 0;
+  unsigned Instructions = 0;
+  double Estimate = 0;
+};
+
+// Counters of one analyzed function, kept for the reports after its
+// module is gone.
+struct FunctionSummary {
+  std::string Module;
+  std::string Name;
+  MyAnalysis Analysis;
+  FunctionCost Cost;
+  DataflowStats Stats;
+  // Wall time of all the analyses of the function together.
+  TimeRecord Time;
+};
+
+static FunctionCost estimateCost(const Function &F) {
+  FunctionCost Cost;
+  for(const BasicBlock &BB : F){
+    Cost.Blocks++;
+    Cost.Edges += succ_size(&BB);
+    Cost.Instructions += BB.size();
   }
+  Cost.Estimate = CostPerBlock * Cost.Blocks + CostPerEdge * Cost.Edges +
+                  CostPerInst * Cost.Instructions;
+  return Cost;
+}
 
+static PressureOptions getPressureOptions() {
+  PressureOptions Options;
+  Options.SplitByClass = PressureByClass;
+  Options.TopK = PressureTop;
+  return Options;
+}
 
+static void registerAnalyses(FunctionAnalysisManager &FAM,
+                             AnalysisCache *Cache) {
   // Create an analysis manager and register the analysis pass with it.
-  FunctionAnalysisManager FAM;
-  //FAM.registerPass([&] { return DominatorsAnalysis(); });
-  FAM.registerPass([&] { return LivenessAnalysis(); });
-  FAM.registerPass([&] { return DominatorsAnalysis(); });
+  LivenessOptions LivenessOpts;
+  LivenessOpts.Algorithm = LivenessAlgorithmOpt;
+  LivenessOpts.MaterializeInstLiveOut = EagerLiveness;
+  LivenessOpts.ResultCache = Cache;
+  FAM.registerPass([=] { return LivenessAnalysis(LivenessOpts); });
+  FAM.registerPass([=] { return DominatorsAnalysis(DomAlgorithmOpt, Cache); });
+  FAM.registerPass([=] { return PostDominatorsAnalysis(DomAlgorithmOpt); });
+  FAM.registerPass([] { return DominanceFrontiersAnalysis(); });
+  FAM.registerPass([] { return RegisterPressureAnalysis(getPressureOptions()); });
+  InterferenceOptions InterferenceOpts;
+  InterferenceOpts.Storage = InterferenceStorageOpt;
+  FAM.registerPass([=] { return InterferenceGraphAnalysis(InterferenceOpts); });
+  // The numberings, CFG lists and traversal order both analyses start from.
+  FAM.registerPass([] { return FunctionInfoAnalysis(); });
 
   // Register all available module analysis passes defined in PassRegisty.def.
   // We only really need PassInstrumentationAnalysis (which is pulled by
@@ -78,13 +301,591 @@ static void doAnalysis(Module &M, MyAnalysis MA) {
   // the _heavy-lifting_.
   PassBuilder PB;
   PB.registerFunctionAnalyses(FAM);
+}
+
+// Runs the selected analyses on F in order and prints their results to
+// OS. Stats[I] receives the counters and timings of analysis MAs[I].
+static void analyzeFunction(Function &F, ArrayRef<MyAnalysis> MAs,
+                            FunctionAnalysisManager &FAM, raw_ostream &OS,
+                            MutableArrayRef<DataflowStats> Stats) {
+  // Create a function pass manager and add the specified pas to it.
+  FunctionPassManager FPM;
+  for(MyAnalysis MA : MAs){
+    switch(MA){
+    case MyAnalysis::DOMINATORS:
+        FPM.addPass(DominatorsAnalysisPrinter(OS, DomAlgorithmOpt, OutputFormatOpt));
+        break;
+    case MyAnalysis::LIVENESS:
+        FPM.addPass(LivenessAnalysisPrinter(OS, LivenessAlgorithmOpt, OutputFormatOpt));
+        break;
+    case MyAnalysis::POSTDOMINATORS:
+        FPM.addPass(PostDominatorsAnalysisPrinter(OS, DomAlgorithmOpt, OutputFormatOpt));
+        break;
+    case MyAnalysis::FRONTIERS:
+        FPM.addPass(DominanceFrontiersAnalysisPrinter(OS, OutputFormatOpt));
+        break;
+    case MyAnalysis::PRESSURE:
+        FPM.addPass(RegisterPressureAnalysisPrinter(OS, getPressureOptions(),
+                                                    OutputFormatOpt));
+        break;
+    case MyAnalysis::INTERFERENCE:
+        FPM.addPass(InterferenceGraphAnalysisPrinter(OS, OutputFormatOpt));
+        break;
+    }
+  }
+
+  // JSON records carry the function name themselves.
+  if(OutputFormatOpt == OutputFormat::Text)
+    OS << "=====Function: " << F.getName() << "=====\n";
+  FPM.run(F, FAM);
+
+  // The printers preserve all analyses, so the results are still cached.
+  for(unsigned I = 0; I != MAs.size(); I++){
+    switch(MAs[I]){
+    case MyAnalysis::DOMINATORS:
+        if(auto *Result = FAM.getCachedResult<DominatorsAnalysis>(F))
+          Stats[I] = Result->Stats;
+        break;
+    case MyAnalysis::LIVENESS:
+        if(auto *Result = FAM.getCachedResult<LivenessAnalysis>(F))
+          Stats[I] = Result->Stats;
+        break;
+    case MyAnalysis::POSTDOMINATORS:
+        if(auto *Result = FAM.getCachedResult<PostDominatorsAnalysis>(F))
+          Stats[I] = Result->Stats;
+        break;
+    case MyAnalysis::FRONTIERS:
+        if(auto *Result = FAM.getCachedResult<DominanceFrontiersAnalysis>(F))
+          Stats[I] = Result->Stats;
+        break;
+    case MyAnalysis::PRESSURE:
+        if(auto *Result = FAM.getCachedResult<RegisterPressureAnalysis>(F))
+          Stats[I] = Result->Stats;
+        break;
+    case MyAnalysis::INTERFERENCE:
+        if(auto *Result = FAM.getCachedResult<InterferenceGraphAnalysis>(F))
+          Stats[I] = Result->Stats;
+        break;
+    }
+  }
+}
+
+// Name of analysis MA in -analysis and in the reports.
+static StringRef getAnalysisName(MyAnalysis MA) {
+  switch(MA){
+  case MyAnalysis::DOMINATORS:
+    return "dom";
+  case MyAnalysis::LIVENESS:
+    return "liveout";
+  case MyAnalysis::POSTDOMINATORS:
+    return "postdom";
+  case MyAnalysis::FRONTIERS:
+    return "df";
+  case MyAnalysis::PRESSURE:
+    return "pressure";
+  case MyAnalysis::INTERFERENCE:
+    return "interference";
+  }
+  llvm_unreachable("unknown analysis");
+}
+
+// The frontiers are walked off the tree of the dominators analysis, and the
+// pressure and the interference graph are built from the liveness, so they
+// report the algorithm of that analysis.
+static StringRef getAlgorithmName(MyAnalysis MA) {
+  if(MA != MyAnalysis::LIVENESS && MA != MyAnalysis::PRESSURE &&
+     MA != MyAnalysis::INTERFERENCE)
+    return DomAlgorithmOpt == DomAlgorithm::Sets ? "sets" : "idom";
+  switch(LivenessAlgorithmOpt){
+  case LivenessAlgorithm::Iterative:
+    return "iterative";
+  case LivenessAlgorithm::PathExploration:
+    return "ssa";
+  case LivenessAlgorithm::LoopForest:
+    return "loops";
+  }
+  llvm_unreachable("unknown liveness algorithm");
+}
+
+// Writes one JSON object per function and analysis with its counters and
+// the wall time of each phase in seconds.
+static void writeJSONSummary(ArrayRef<FunctionSummary> Summaries) {
+  std::error_code EC;
+  raw_fd_ostream File(JSONSummary, EC, sys::fs::OF_Text);
+  if(EC){
+    errs() << "Error opening " << JSONSummary << ": " << EC.message() << "\n";
+    return;
+  }
+
+  json::OStream J(File, /*IndentSize=*/2);
+  J.array([&] {
+    for(const FunctionSummary &FS : Summaries){
+      const DataflowStats &S = FS.Stats;
+      J.object([&] {
+        // Only batch runs analyze more than one module.
+        if(!FS.Module.empty())
+          J.attribute("module", FS.Module);
+        J.attribute("function", FS.Name);
+        J.attribute("analysis", getAnalysisName(FS.Analysis));
+        J.attribute("algorithm", getAlgorithmName(FS.Analysis));
+        J.attribute("blocks", int64_t(FS.Cost.Blocks));
+        J.attribute("edges", int64_t(FS.Cost.Edges));
+        J.attribute("instructions", int64_t(FS.Cost.Instructions));
+        J.attribute("estimated_cost", FS.Cost.Estimate);
+        J.attribute("function_time", FS.Time.getWallTime());
+        J.attribute("sweeps", int64_t(S.Sweeps));
+        J.attribute("block_visits", int64_t(S.BlockVisits));
+        J.attribute("changes", int64_t(S.Changes));
+        J.attribute("set_insertions", int64_t(S.SetInsertions));
+        J.attribute("set_erasures", int64_t(S.SetErasures));
+        J.attribute("set_compares", int64_t(S.SetCompares));
+        J.attributeObject("time", [&] {
+          J.attribute("init", S.InitTime.getWallTime());
+          J.attribute("fixed_point", S.FixedPointTime.getWallTime());
+          J.attribute("expansion", S.ExpansionTime.getWallTime());
+        });
+      });
+    }
+  });
+  File << "\n";
+}
+
+// Prints the phase timings of analysis MA summed over all functions in the
+// -time-passes format.
+static void printPhaseTimes(MyAnalysis MA, ArrayRef<FunctionSummary> Summaries) {
+  DataflowStats Total;
+  for(const FunctionSummary &FS : Summaries)
+    if(FS.Analysis == MA)
+      Total += FS.Stats;
+
+  StringMap<TimeRecord> Records;
+  Records["Initialization"] = Total.InitTime;
+  Records["Fixed point"] = Total.FixedPointTime;
+  Records["Expansion"] = Total.ExpansionTime;
+  StringRef Title;
+  switch(MA){
+  case MyAnalysis::DOMINATORS:
+    Title = "Dominators";
+    break;
+  case MyAnalysis::LIVENESS:
+    Title = "Liveness";
+    break;
+  case MyAnalysis::POSTDOMINATORS:
+    Title = "Post-dominators";
+    break;
+  case MyAnalysis::FRONTIERS:
+    Title = "Dominance frontiers";
+    break;
+  case MyAnalysis::PRESSURE:
+    Title = "Register pressure";
+    break;
+  case MyAnalysis::INTERFERENCE:
+    Title = "Interference graph";
+    break;
+  }
+  std::string Description =
+      (Title + " analysis phases (" + getAlgorithmName(MA) + ")").str();
+  TimerGroup TG("analysis-phases", Description, Records);
+  TG.print(errs());
+}
+
+// -stats is registered by LLVM even when it was built without statistics,
+// in which case it complains at exit instead of printing them. The counters
+// of this tool are always tracked, so print them here and clear the flag.
+static void printStatistics() {
+  if(!AreStatisticsEnabled())
+    return;
+  PrintStatistics(errs());
+  auto &Options = cl::getRegisteredOptions();
+  auto It = Options.find("stats");
+  if(It != Options.end())
+    static_cast<cl::opt<bool, true> *>(It->second)->setValue(false);
+}
+
+// Analyzes Functions on NumThreads workers. Every worker owns its own
+// FunctionAnalysisManager. Functions are dealt largest estimated cost first,
+// each to the worker with the least cost dealt so far, so that the long
+// tail of huge functions is spread over the workers and started early. A
+// worker whose queue runs dry steals the largest function of the queue
+// with the most cost left. Output is buffered per function and emitted in
+// module order, so it is byte-identical to the serial run.
+static void doParallelAnalysis(ArrayRef<Function *> Functions,
+                               ArrayRef<FunctionCost> Costs,
+                               ArrayRef<MyAnalysis> MAs, unsigned NumThreads,
+                               raw_ostream &Out, AnalysisCache *Cache,
+                               std::vector<DataflowStats> &Stats,
+                               std::vector<TimeRecord> &Times) {
+  std::vector<unsigned> ByCost(Functions.size());
+  std::iota(ByCost.begin(), ByCost.end(), 0);
+  std::stable_sort(ByCost.begin(), ByCost.end(), [&](unsigned A, unsigned B) {
+    return Costs[A].Estimate > Costs[B].Estimate;
+  });
+
+  struct WorkQueue {
+    std::mutex Lock;
+    std::deque<unsigned> Items;
+    // Estimated cost of Items.
+    double Load = 0;
+  };
+  std::vector<WorkQueue> Queues(NumThreads);
+  for(unsigned Item : ByCost){
+    WorkQueue *Min = &Queues[0];
+    for(WorkQueue &Q : Queues)
+      if(Q.Load < Min->Load)
+        Min = &Q;
+    Min->Items.push_back(Item);
+    Min->Load += Costs[Item].Estimate;
+  }
+
+  // Pops the largest remaining function of queue Q.
+  auto Pop = [&](unsigned Q, unsigned &Item) {
+    std::lock_guard<std::mutex> Guard(Queues[Q].Lock);
+    if(Queues[Q].Items.empty())
+      return false;
+    Item = Queues[Q].Items.front();
+    Queues[Q].Items.pop_front();
+    Queues[Q].Load -= Costs[Item].Estimate;
+    return true;
+  };
+  // Pops from the queue with the most cost left, or fails once all queues
+  // are empty.
+  auto Steal = [&](unsigned &Item) {
+    while(true){
+      unsigned Victim = NumThreads;
+      double MaxLoad = 0;
+      for(unsigned Q = 0; Q != NumThreads; Q++){
+        std::lock_guard<std::mutex> Guard(Queues[Q].Lock);
+        if(!Queues[Q].Items.empty() &&
+           (Victim == NumThreads || Queues[Q].Load > MaxLoad)){
+          Victim = Q;
+          MaxLoad = Queues[Q].Load;
+        }
+      }
+      if(Victim == NumThreads)
+        return false;
+      // Another thief may have emptied it meanwhile.
+      if(Pop(Victim, Item))
+        return true;
+    }
+  };
+
+  std::vector<std::string> Output(Functions.size());
+  std::vector<bool> Done(Functions.size(), false);
+  std::mutex DoneLock;
+  std::condition_variable DoneCV;
 
-  // Finally, run the passes registered with MPM
+  auto Worker = [&](unsigned Self) {
+    FunctionAnalysisManager FAM;
+    registerAnalyses(FAM, Cache);
+    unsigned Item;
+    while(Pop(Self, Item) || Steal(Item)){
+      raw_string_ostream OS(Output[Item]);
+      {
+        PhaseTimer Timer(Times[Item]);
+        analyzeFunction(*Functions[Item], MAs, FAM, OS,
+                        MutableArrayRef<DataflowStats>(Stats).slice(
+                            Item * MAs.size(), MAs.size()));
+      }
+      OS.flush();
+      // Results are not reused across functions.
+      FAM.clear();
+      {
+        std::lock_guard<std::mutex> Guard(DoneLock);
+        Done[Item] = true;
+      }
+      DoneCV.notify_one();
+    }
+  };
+
+  std::vector<std::thread> Threads;
+  for(unsigned I = 0; I != NumThreads; I++)
+    Threads.emplace_back(Worker, I);
+
+  // Emit in module order as soon as each function is ready.
+  for(unsigned I = 0; I != Functions.size(); I++){
+    std::unique_lock<std::mutex> Guard(DoneLock);
+    DoneCV.wait(Guard, [&] { return Done[I]; });
+    Guard.unlock();
+    Out << Output[I];
+    std::string().swap(Output[I]);
+  }
+
+  for(auto &T : Threads)
+    T.join();
+}
+
+// Reads the module at Path. With -lazy the function bodies stay in the
+// bitcode, which is memory-mapped when it is large enough, until they are
+// materialized.
+static std::unique_ptr<Module> loadModule(StringRef Path, SMDiagnostic &Err,
+                                          LLVMContext &Ctx) {
+  if(LazyLoading)
+    return getLazyIRFileModule(Path, Err, Ctx);
+  return parseIRFile(Path, Err, Ctx);
+}
+
+// Analyzes the functions of a lazily loaded module in order, skipping
+// declarations. Each body is materialized right before it is analyzed and
+// deleted right after its results are printed, so peak memory follows the
+// largest function rather than the module.
+static Error analyzeModuleLazily(Module &M, ArrayRef<MyAnalysis> MAs,
+                                 raw_ostream &Out,
+                                 AnalysisCache *Cache, StringRef ModuleName,
+                                 std::vector<FunctionSummary> &Summaries) {
+  FunctionAnalysisManager FAM;
+  registerAnalyses(FAM, Cache);
+  for(auto &F : M){
+    if(F.isDeclaration())
+      continue;
+    bool WasMaterializable = F.isMaterializable();
+    if(Error E = F.materialize())
+      return E;
+
+    SmallVector<DataflowStats, 2> Stats(MAs.size());
+    TimeRecord Time;
+    {
+      PhaseTimer Timer(Time);
+      analyzeFunction(F, MAs, FAM, Out, Stats);
+    }
+    FunctionCost Cost = estimateCost(F);
+    for(unsigned I = 0; I != MAs.size(); I++)
+      Summaries.push_back({ModuleName.str(), F.getName().str(), MAs[I], Cost,
+                           Stats[I], Time});
+
+    // The cached results refer to the blocks about to be deleted.
+    FAM.clear(F, F.getName());
+    if(WasMaterializable)
+      F.deleteBody();
+  }
+  return Error::success();
+}
+
+// Analyzes the functions defined in M, printing the results to Out in
+// module order, and appends their summaries to Summaries. ModuleName is
+// recorded in the summaries.
+static Error analyzeModule(Module &M, ArrayRef<MyAnalysis> MAs,
+                           raw_ostream &Out,
+                           AnalysisCache *Cache, StringRef ModuleName,
+                           std::vector<FunctionSummary> &Summaries) {
+  if(LazyLoading)
+    return analyzeModuleLazily(M, MAs, Out, Cache, ModuleName, Summaries);
+
+  std::vector<Function *> Functions;
+  std::vector<FunctionCost> Costs;
   for(auto &F : M){
-     llvm::errs() << "=====Function: " << F.getName() << "=====\n";
-     FPM.run(F, FAM);
+    if(F.isDeclaration())
+      continue;
+    Functions.push_back(&F);
+    Costs.push_back(estimateCost(F));
+  }
+
+  // The stats of function I and analysis J are at I * MAs.size() + J.
+  std::vector<DataflowStats> Stats(Functions.size() * MAs.size());
+  std::vector<TimeRecord> Times(Functions.size());
+  if(NumThreads > 1 && Functions.size() > 1){
+    doParallelAnalysis(Functions, Costs, MAs,
+                       std::min<unsigned>(NumThreads, Functions.size()), Out,
+                       Cache, Stats, Times);
+  } else {
+    FunctionAnalysisManager FAM;
+    registerAnalyses(FAM, Cache);
+
+    // Finally, run the passes registered with MPM
+    for(unsigned I = 0; I != Functions.size(); I++){
+       PhaseTimer Timer(Times[I]);
+       analyzeFunction(*Functions[I], MAs, FAM, Out,
+                       MutableArrayRef<DataflowStats>(Stats).slice(
+                           I * MAs.size(), MAs.size()));
+    }
+  }
+
+  for(unsigned I = 0; I != Functions.size(); I++){
+    for(unsigned J = 0; J != MAs.size(); J++)
+      Summaries.push_back({ModuleName.str(), Functions[I]->getName().str(),
+                           MAs[J], Costs[I], Stats[I * MAs.size() + J],
+                           Times[I]});
+  }
+  return Error::success();
+}
+
+// Prints the reports requested on the command line, over all analyzed
+// functions.
+static void printReports(ArrayRef<MyAnalysis> MAs,
+                         ArrayRef<FunctionSummary> Summaries,
+                         AnalysisCache *Cache) {
+  if(!JSONSummary.empty())
+    writeJSONSummary(Summaries);
+  if(TimePassesIsEnabled)
+    for(MyAnalysis MA : MAs)
+      printPhaseTimes(MA, Summaries);
+  if(Cache)
+    Cache->printReport(errs());
+  printStatistics();
+}
+
+//===----------------------------------------------------------------------===//
+// Batch mode
+//===----------------------------------------------------------------------===//
+// A FIFO between two pipeline stages. push blocks while the queue holds
+// Capacity items; pop blocks while it is empty and fails once it is empty
+// and closed.
+template <typename T> class BoundedQueue {
+public:
+  explicit BoundedQueue(unsigned Capacity) : Capacity(std::max(1U, Capacity)) {}
+
+  void push(T Item) {
+    std::unique_lock<std::mutex> Guard(Lock);
+    NotFull.wait(Guard, [&] { return Items.size() < Capacity; });
+    Items.push_back(std::move(Item));
+    NotEmpty.notify_one();
+  }
+
+  bool pop(T &Item) {
+    std::unique_lock<std::mutex> Guard(Lock);
+    NotEmpty.wait(Guard, [&] { return !Items.empty() || Closed; });
+    if(Items.empty())
+      return false;
+    Item = std::move(Items.front());
+    Items.pop_front();
+    NotFull.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Closed = true;
+    NotEmpty.notify_all();
+  }
+
+private:
+  unsigned Capacity;
+  std::mutex Lock;
+  std::condition_variable NotFull, NotEmpty;
+  std::deque<T> Items;
+  bool Closed = false;
+};
+
+// Collects the modules named by -batch: the .bc and .ll files of a
+// directory in name order, or the lines of a list file. Empty lines and
+// lines starting with '#' are skipped.
+static bool collectBatchInputs(StringRef Batch, std::vector<std::string> &Paths) {
+  if(sys::fs::is_directory(Batch)){
+    std::error_code EC;
+    for(sys::fs::directory_iterator It(Batch, EC), End; It != End && !EC;
+        It.increment(EC)){
+      StringRef Ext = sys::path::extension(It->path());
+      if((Ext == ".bc" || Ext == ".ll") && !sys::fs::is_directory(It->path()))
+        Paths.push_back(It->path());
+    }
+    if(EC){
+      errs() << "Error reading " << Batch << ": " << EC.message() << "\n";
+      return false;
+    }
+    llvm::sort(Paths);
+    return true;
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> List = MemoryBuffer::getFile(Batch);
+  if(!List){
+    errs() << "Error reading " << Batch << ": " << List.getError().message() << "\n";
+    return false;
+  }
+  SmallVector<StringRef, 64> Lines;
+  (*List)->getBuffer().split(Lines, '\n');
+  for(StringRef Line : Lines){
+    Line = Line.trim();
+    if(!Line.empty() && !Line.startswith("#"))
+      Paths.push_back(Line.str());
   }
- 
+  return true;
+}
+
+// Analyzes the modules of -batch as a three-stage pipeline: a parser
+// thread reads every module into its own LLVMContext, this thread analyzes
+// them, and an emitter thread writes the results in input order. The
+// queues between the stages bound the number of modules alive at once.
+// Modules that fail to parse are reported and skipped.
+static int runBatch(ArrayRef<MyAnalysis> MAs, raw_ostream &Out,
+                    AnalysisCache *Cache,
+                    StringRef ProgName) {
+  std::vector<std::string> Paths;
+  if(!collectBatchInputs(BatchInput, Paths))
+    return -1;
+
+  struct ParsedModule {
+    std::string Path;
+    std::unique_ptr<LLVMContext> Ctx;
+    std::unique_ptr<Module> M;
+    std::string Error;
+  };
+  struct ModuleOutput {
+    std::string Results;
+    std::string Error;
+  };
+  BoundedQueue<ParsedModule> Parsed(BatchQueueDepth);
+  BoundedQueue<ModuleOutput> Analyzed(BatchQueueDepth);
+
+  std::thread Parser([&] {
+    for(const std::string &Path : Paths){
+      ParsedModule P;
+      P.Path = Path;
+      P.Ctx = std::make_unique<LLVMContext>();
+      SMDiagnostic Err;
+      P.M = loadModule(Path, Err, *P.Ctx);
+      if(!P.M){
+        raw_string_ostream OS(P.Error);
+        OS << "Error reading bitcode file: " << Path << "\n";
+        Err.print(ProgName.data(), OS);
+      }
+      Parsed.push(std::move(P));
+    }
+    Parsed.close();
+  });
+
+  // Errors go through the emitter too, so that only one thread writes to
+  // stderr while the pipeline runs.
+  std::thread Emitter([&] {
+    ModuleOutput O;
+    while(Analyzed.pop(O)){
+      errs() << O.Error;
+      Out << O.Results;
+    }
+  });
+
+  std::vector<FunctionSummary> Summaries;
+  unsigned Failures = 0;
+  ParsedModule P;
+  while(Parsed.pop(P)){
+    ModuleOutput O;
+    if(P.M){
+      raw_string_ostream OS(O.Results);
+      if(OutputFormatOpt == OutputFormat::Text)
+        OS << "=====Module: " << P.Path << "=====\n";
+      if(Error E = analyzeModule(*P.M, MAs, OS, Cache, P.Path, Summaries)){
+        O.Error = "Error analyzing " + P.Path + ": " + toString(std::move(E)) + "\n";
+        Failures++;
+      }
+      OS.flush();
+    } else {
+      O.Error = std::move(P.Error);
+      Failures++;
+    }
+    // The module must go before its context.
+    P.M.reset();
+    P.Ctx.reset();
+    Analyzed.push(std::move(O));
+  }
+  Analyzed.close();
+  Parser.join();
+  Emitter.join();
+
+  printReports(MAs, Summaries, Cache);
+  if(Failures){
+    errs() << Failures << " of " << Paths.size()
+           << " modules could not be read or analyzed\n";
+    return -1;
+  }
+  return 0;
 }
 
 //===----------------------------------------------------------------------===//
@@ -103,20 +904,67 @@ int main(int Argc, char **Argv) {
   //  http://llvm.org/docs/ProgrammersManual.html#ending-execution-with-llvm-shutdown
   llvm_shutdown_obj SDO;
 
-  // Parse the IR file passed on the command line.
-  SMDiagnostic Err;
-  LLVMContext Ctx;
-  std::unique_ptr<Module> M = parseIRFile(InputModule.getValue(), Err, Ctx);
-  MyAnalysis analysis = AnalysisType.getValue();
-
-  if (!M) {
-    errs() << "Error reading bitcode file: " << InputModule << "\n";
-    Err.print(Argv[0], errs());
+  if(InputModule.empty() == BatchInput.empty()){
+    errs() << Argv[0] << ": expected either one module or -batch\n";
     return -1;
   }
+  if(LazyLoading && NumThreads > 1)
+    errs() << Argv[0] << ": warning: -lazy analyzes functions serially, "
+           << "ignoring -j\n";
+  // Each analysis runs once, in the order first given.
+  SmallVector<MyAnalysis, 2> Analyses;
+  for(MyAnalysis MA : AnalysisTypes)
+    if(!is_contained(Analyses, MA))
+      Analyses.push_back(MA);
 
-  // Run the analysis and print the results
-  doAnalysis(*M, analysis);
+  // Results go to stderr unless an output file is given. The file stream is
+  // buffered, which matters for large modules.
+  std::unique_ptr<ToolOutputFile> OutFile;
+  if(!OutputFilename.empty()){
+    std::error_code EC;
+    OutFile = std::make_unique<ToolOutputFile>(OutputFilename, EC,
+                                               sys::fs::OF_Text);
+    if(EC){
+      errs() << "Error opening " << OutputFilename << ": " << EC.message() << "\n";
+      return -1;
+    }
+  }
 
-  return 0;
+  std::unique_ptr<AnalysisCache> Cache;
+  if(!CacheDir.empty()){
+    Cache = std::make_unique<AnalysisCache>(CacheDir);
+    if(std::error_code EC = Cache->create()){
+      errs() << "Error creating " << CacheDir << ": " << EC.message() << "\n";
+      return -1;
+    }
+  }
+
+  raw_ostream &Out = OutFile ? OutFile->os() : errs();
+  int Status = 0;
+  if(!BatchInput.empty()){
+    Status = runBatch(Analyses, Out, Cache.get(), Argv[0]);
+  } else {
+    // Parse the IR file passed on the command line.
+    SMDiagnostic Err;
+    LLVMContext Ctx;
+    std::unique_ptr<Module> M = loadModule(InputModule, Err, Ctx);
+    if (!M) {
+      errs() << "Error reading bitcode file: " << InputModule << "\n";
+      Err.print(Argv[0], errs());
+      return -1;
+    }
+
+    // Run the analysis and print the results
+    std::vector<FunctionSummary> Summaries;
+    if(Error E = analyzeModule(*M, Analyses, Out, Cache.get(), "", Summaries)){
+      errs() << "Error analyzing " << InputModule << ": "
+             << toString(std::move(E)) << "\n";
+      return -1;
+    }
+    printReports(Analyses, Summaries, Cache.get());
+  }
+  if(OutFile)
+    OutFile->keep();
+
+  return Status;
 }
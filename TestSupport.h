@@ -0,0 +1,58 @@
+//========================================================================
+// FILE:
+//    TestSupport.h
+//
+// DESCRIPTION:
+//    Checks shared by the test executables. Each test is a single
+//    translation unit, so the counters below are per test.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_ANALYSIS_TESTSUPPORT_H
+#define LLVM_ANALYSIS_TESTSUPPORT_H
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace llvm {
+
+static unsigned NumChecks = 0;
+static unsigned NumFailures = 0;
+
+static void check(bool Cond, const Twine &What) {
+  NumChecks++;
+  if (Cond)
+    return;
+  NumFailures++;
+  errs() << "FAILED: " << What << "\n";
+}
+
+// Value of the statistic DebugType.Name, or 0 if it was never bumped.
+// Statistics are only collected after EnableStatistics(), and only when
+// LLVM_ENABLE_STATS is set.
+static unsigned getStatistic(StringRef Key) {
+  std::string Buffer;
+  raw_string_ostream OS(Buffer);
+  PrintStatisticsJSON(OS);
+  Expected<json::Value> Stats = json::parse(OS.str());
+  if (!Stats) {
+    consumeError(Stats.takeError());
+    return 0;
+  }
+  if (const json::Object *O = Stats->getAsObject())
+    if (Optional<int64_t> Value = O->getInteger(Key))
+      return *Value;
+  return 0;
+}
+
+// Prints the totals and returns the exit code of the test.
+static int reportChecks() {
+  outs() << NumChecks << " checks, " << NumFailures << " failures\n";
+  return NumFailures ? 1 : 0;
+}
+
+} // End namespace llvm
+
+#endif // LLVM_ANALYSIS_TESTSUPPORT_H
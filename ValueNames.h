@@ -0,0 +1,90 @@
+//========================================================================
+// FILE:
+//    ValueNames.h
+//
+// DESCRIPTION:
+//    Naming and output helpers shared by the printers. Value::
+//    getNameOrAsOperand is only available in LLVM builds with assertions
+//    enabled, so the printers use getValueName instead. ValueNameCache
+//    names the values of a single function once, numbering the unnamed
+//    ones with one shared slot tracker.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_ANALYSIS_VALUENAMES_H
+#define LLVM_ANALYSIS_VALUENAMES_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/ModuleSlotTracker.h"
+#include "llvm/IR/Value.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <string>
+
+namespace llvm {
+
+// Output formats of the printers: the human readable listing, or one JSON
+// object per basic block and line.
+enum class OutputFormat { Text, JSONLines };
+
+inline std::string getValueName(const Value &V) {
+  if (!V.getName().empty())
+    return std::string(V.getName());
+
+  std::string Name;
+  raw_string_ostream OS(Name);
+  V.printAsOperand(OS, false);
+  return OS.str();
+}
+
+// Names the values and blocks of function F. printAsOperand and
+// Instruction::print build a new slot tracker over the whole function on
+// every call to number unnamed values; this cache builds it once and keeps
+// the names it produced for the lifetime of the cache.
+class ValueNameCache {
+public:
+  explicit ValueNameCache(const Function &F) : F(F), Saver(Allocator) {}
+
+  // Same as getValueName, but the result stays valid as long as the cache.
+  StringRef get(const Value &V) {
+    if (!V.getName().empty())
+      return V.getName();
+
+    auto It = Names.find(&V);
+    if (It != Names.end())
+      return It->second;
+    std::string Name;
+    raw_string_ostream OS(Name);
+    V.printAsOperand(OS, false, getSlotTracker());
+    return Names[&V] = Saver.save(OS.str());
+  }
+
+  void printInstruction(raw_ostream &OS, const Instruction &I) {
+    I.print(OS, getSlotTracker());
+  }
+
+private:
+  ModuleSlotTracker &getSlotTracker() {
+    if (!MST) {
+      MST = std::make_unique<ModuleSlotTracker>(F.getParent());
+      MST->incorporateFunction(F);
+    }
+    return *MST;
+  }
+
+  const Function &F;
+  std::unique_ptr<ModuleSlotTracker> MST;
+  BumpPtrAllocator Allocator;
+  StringSaver Saver;
+  DenseMap<const Value *, StringRef> Names;
+};
+
+} // End namespace llvm
+
+#endif // LLVM_ANALYSIS_VALUENAMES_H
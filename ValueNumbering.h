@@ -0,0 +1,81 @@
+//========================================================================
+// FILE:
+//    ValueNumbering.h
+//
+// DESCRIPTION:
+//    Maps the values of a function that can be live (its arguments and
+//    the instructions that produce a value) to dense indices [0, N), so
+//    sets of values can be stored as bit vectors. Arguments come first,
+//    followed by the instructions in layout order. Instructions inserted
+//    later are appended, and the numbers of erased ones are retired.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_ANALYSIS_VALUENUMBERING_H
+#define LLVM_ANALYSIS_VALUENUMBERING_H
+
+#include "BlockNumbering.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+#include <vector>
+
+namespace llvm {
+
+class ValueNumbering {
+public:
+  ValueNumbering() = default;
+  explicit ValueNumbering(const Function &F) {
+    for (const Argument &Arg : F.args())
+      addValue(&Arg);
+    for (const BasicBlock &BB : F)
+      for (const Instruction &I : BB)
+        if (!I.getType()->isVoidTy())
+          addValue(&I);
+  }
+
+  // Number of indices handed out, including retired ones.
+  unsigned size() const { return Values.size(); }
+
+  // Returns nullptr for retired indices.
+  const Value *getValue(unsigned Idx) const { return Values[Idx]; }
+
+  // Returns InvalidIndex for values that are never live, such as
+  // constants, globals, basic blocks and metadata.
+  unsigned getIndex(const Value *V) const {
+    auto It = Index.find(V);
+    return It == Index.end() ? unsigned(BlockNumbering::InvalidIndex)
+                             : It->second;
+  }
+
+  ArrayRef<const Value *> values() const { return Values; }
+
+  // Numbers a new value with the next free index and returns it.
+  unsigned addValue(const Value *V) {
+    Index[V] = Values.size();
+    Values.push_back(V);
+    return Values.size() - 1;
+  }
+
+  // Retires the index of V, which is about to be deleted. The index is not
+  // reused, so sets over the numbering keep their meaning.
+  void removeValue(const Value *V) {
+    auto It = Index.find(V);
+    if (It == Index.end())
+      return;
+    Values[It->second] = nullptr;
+    Index.erase(It);
+  }
+
+private:
+
+  std::vector<const Value *> Values;
+  DenseMap<const Value *, unsigned> Index;
+};
+
+} // End namespace llvm
+
+#endif // LLVM_ANALYSIS_VALUENUMBERING_H